@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <algorithm>
+#include <cstdio>
+
+#include <core/macro_scheduler.hpp>
+
+#include "bench.hpp"
+
+/* constants */
+constexpr auto MIN_DURATION =	100000000LL;
+constexpr auto MAX_ITERATIONS =	1000000000ULL;
+
+void Bench::add(std::string name, Function function, std::size_t batch, Function reset) {
+	benchmarks_.push_back(Benchmark{name, function, batch, reset});
+}
+
+int Bench::run(std::string filter) {
+	int nRun = 0;
+
+	std::printf("%-40s %12s %12s %14s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+
+	for (auto &benchmark : benchmarks_) {
+		if (benchmark.name.find(filter) == std::string::npos) {
+			continue;
+		}
+
+		// warm up caches and lazily initialized state
+		benchmark.function();
+
+		if (benchmark.reset) {
+			benchmark.reset();
+		}
+
+		unsigned long long iterations = 1;
+		long long elapsed;
+		unsigned long long allocated;
+
+		while (true) {
+			elapsed = 0;
+			allocated = 0;
+
+			for (unsigned long long i = 0; i < iterations;) {
+				auto batch = benchmark.batch ? std::min<unsigned long long>(benchmark.batch, iterations - i) : iterations;
+				auto startAllocations = allocations.load();
+				auto start = MacroScheduler::now();
+
+				for (unsigned long long j = 0; j < batch; j++) {
+					benchmark.function();
+				}
+
+				elapsed += MacroScheduler::now() - start;
+				allocated += allocations.load() - startAllocations;
+				i += batch;
+
+				if (benchmark.reset) {
+					benchmark.reset();
+				}
+			}
+
+			if (elapsed >= MIN_DURATION || iterations >= MAX_ITERATIONS) {
+				break;
+			}
+
+			iterations *= 2;
+		}
+
+		std::printf("%-40s %12llu %12.1f %14.2f\n", benchmark.name.c_str(), iterations,
+				static_cast<double>(elapsed) / iterations,
+				static_cast<double>(allocated) / iterations);
+		nRun++;
+	}
+
+	return nRun;
+}
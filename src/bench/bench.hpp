@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef BENCH_CLASS_H
+#define BENCH_CLASS_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Number of heap allocations made by the process, counted by the global
+ * operator new of the benchmark executable.
+ */
+extern std::atomic<unsigned long long> allocations;
+
+/**
+ * Class running micro-benchmarks.
+ *
+ * Each benchmark is run with a growing number of iterations, until it takes
+ * long enough to be measured reliably. Results are reported as nanoseconds and
+ * heap allocations per operation.
+ */
+class Bench {
+	public:
+		typedef std::function<void()> Function;
+
+		/**
+		 * Registers benchmark.
+		 * @param name unique name, e.g. "decode/sidewinder"
+		 * @param function single operation to be measured
+		 * @param batch number of operations timed in a row, 0 for all
+		 * @param reset restores state after every batch, e.g. empties
+		 * a queue filled by the operations, not timed
+		 */
+		void add(std::string name, Function function, std::size_t batch = 0, Function reset = Function());
+
+		/**
+		 * Runs all benchmarks, whose name contains filter.
+		 * @return number of benchmarks run
+		 */
+		int run(std::string filter);
+
+	private:
+		struct Benchmark {
+			std::string name;
+			Function function;
+			std::size_t batch;
+			Function reset;
+		};
+
+		std::vector<Benchmark> benchmarks_;
+};
+
+/*
+ * benchmark suites, one per hot path
+ */
+void addInputBenchmarks(Bench *bench);
+void addMacroBenchmarks(Bench *bench);
+void addVirtualInputBenchmarks(Bench *bench);
+void addDeviceManagerBenchmarks(Bench *bench);
+void addControlBenchmarks(Bench *bench);
+void addLoggerBenchmarks(Bench *bench);
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <core/control_server.hpp>
+#include <core/macro.hpp>
+#include <core/reactor.hpp>
+
+#include <test/test.hpp>
+
+#include "bench.hpp"
+
+/* constants */
+constexpr auto RESPONSE_BUFFER_SIZE =	1024;
+
+/*
+ * Sends command and waits for the final response line, so each operation is
+ * a full round trip through the event loop.
+ */
+static void request(int fd, const std::string &command) {
+	char buf[RESPONSE_BUFFER_SIZE];
+	std::string response;
+
+	if (write(fd, command.data(), command.size()) != static_cast<ssize_t>(command.size())) {
+		std::cerr << "Can't send " << command;
+		std::exit(EXIT_FAILURE);
+	}
+
+	while (response.find("ok\n") == std::string::npos) {
+		ssize_t nBytes = read(fd, buf, sizeof(buf));
+
+		if (nBytes > 0) {
+			response.append(buf, nBytes);
+		}
+
+		if (nBytes <= 0 || response.find("error") != std::string::npos) {
+			std::cerr << "Request " << command << "failed: " << response;
+			std::exit(EXIT_FAILURE);
+		}
+	}
+}
+
+void addControlBenchmarks(Bench *bench) {
+	/*
+	 * the daemon side lives until the process exits, as the event loop
+	 * keeps running on its own thread
+	 */
+	auto simulation = new Simulation();
+	auto reactor = &simulation->reactor;
+	auto keyboards = new std::map<std::string, std::unique_ptr<Keyboard>>();
+	auto control = new ControlServer(reactor, keyboards);
+	std::string workdir = simulation->getWorkdir();
+	struct sidewinderd::DevNode devNode;
+	int hidFd;
+
+	/*
+	 * the device side stays open, so the keyboard isn't disconnected, macros
+	 * are played without a device, their output is discarded
+	 */
+	if (simulation->simulate(&devNode, &hidFd, nullptr)) {
+		std::cerr << "Can't create simulated device." << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
+	(*keyboards)["simulated"].reset(simulation->createKeyboard(&devNode));
+
+	// single key press, played from the binary format
+	Macro macro;
+	macro.push_back(MacroEvent{EV_KEY, KEY_A, 1, 0});
+	macro.push_back(MacroEvent{EV_KEY, KEY_A, 0, 0});
+	macro.saveBinary(Macro::getBinaryPath(workdir + "profile_1/s1.xml"));
+
+	auto path = workdir + "control.sock";
+
+	if (control->start(path)) {
+		std::exit(EXIT_FAILURE);
+	}
+
+	std::thread([reactor]() { reactor->run(); }).detach();
+
+	struct sockaddr_un addr = sockaddr_un();
+	addr.sun_family = AF_UNIX;
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+		std::cerr << "Can't connect to control socket." << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
+	bench->add("control/list", [fd]() {
+		request(fd, "list\n");
+	});
+
+	bench->add("control/play", [fd]() {
+		request(fd, "play 0 1 1\n");
+	});
+}
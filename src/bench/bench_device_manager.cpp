@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <process.hpp>
+#include <settings.hpp>
+#include <core/device_manager.hpp>
+
+#include <test/test.hpp>
+
+#include "bench.hpp"
+#include "udev_mock.hpp"
+
+/* constants */
+constexpr auto DISCOVER_DEVICES =	200;
+
+/*
+ * Injects fresh simulated nodes, as the keyboard takes ownership of them. The
+ * device side isn't needed, as the event loop doesn't run.
+ */
+static void simulate(Simulation *simulation, sidewinderd::DevNode *devNode) {
+	if (simulation->simulate(devNode, nullptr, nullptr)) {
+		std::cerr << "Can't create simulated device." << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+}
+
+void addDeviceManagerBenchmarks(Bench *bench) {
+	bench->add("probe/match/supported", []() {
+		DeviceManager::match("045e", "074b");
+	});
+
+	// the common case, most nodes don't belong to any supported device
+	bench->add("probe/match/unsupported", []() {
+		DeviceManager::match("046d", "c52b");
+	});
+
+	// startup scan through libudev, which is replaced by a synthetic tree
+	auto discoverSettings = new SettingsStore("/dev/null");
+	discoverSettings->load();
+	auto deviceManager = new DeviceManager(discoverSettings, new Process());
+
+	bench->add("probe/discover/empty", [deviceManager]() {
+		createDeviceTree(0);
+		deviceManager->discover();
+	});
+
+	auto nNodes = createDeviceTree(DISCOVER_DEVICES);
+
+	bench->add("probe/discover/" + std::to_string(nNodes) + "_nodes", [deviceManager]() {
+		createDeviceTree(DISCOVER_DEVICES);
+		deviceManager->discover();
+	});
+
+	// shared by all keyboards, never destroyed
+	auto simulation = new Simulation();
+	auto devNode = std::make_shared<sidewinderd::DevNode>();
+
+	// what a replug costs without a grace period
+	bench->add("device/create", [simulation, devNode]() {
+		simulate(simulation, devNode.get());
+		std::unique_ptr<Keyboard> keyboard(simulation->createKeyboard(devNode.get()));
+		keyboard->connect();
+	});
+
+	simulate(simulation, devNode.get());
+	std::shared_ptr<Keyboard> keyboard(simulation->createKeyboard(devNode.get()));
+	keyboard->connect();
+
+	// replug within the grace period
+	bench->add("device/reattach", [simulation, keyboard, devNode]() {
+		simulate(simulation, devNode.get());
+		keyboard->detach();
+		keyboard->reattach(devNode.get());
+	});
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <vendor/logitech/g103.hpp>
+#include <vendor/logitech/g105.hpp>
+#include <vendor/logitech/g710.hpp>
+#include <vendor/microsoft/sidewinder.hpp>
+
+#include "bench.hpp"
+
+typedef std::size_t (*Decoder)(const unsigned char *buf, ssize_t nBytes, struct KeyState *state, struct KeyData *keys);
+
+/*
+ * Decodes the given reports round robin, so every operation sees an edge.
+ */
+static void addDecoder(Bench *bench, std::string name, Decoder decoder, std::vector<std::vector<unsigned char>> reports) {
+	struct Context {
+		Decoder decoder;
+		std::vector<std::vector<unsigned char>> reports;
+		std::size_t next;
+		struct KeyState state;
+		struct KeyData keys[MAX_KEY_EVENTS];
+	};
+
+	auto context = std::make_shared<Context>();
+	context->decoder = decoder;
+	context->reports = reports;
+	context->next = 0;
+	context->state = KeyState();
+
+	bench->add("decode/" + name, [context]() {
+		auto &report = context->reports[context->next];
+		context->decoder(report.data(), report.size(), &context->state, context->keys);
+		context->next = (context->next + 1) % context->reports.size();
+	});
+}
+
+void addInputBenchmarks(Bench *bench) {
+	// single macro key pressed and released
+	addDecoder(bench, "sidewinder/single", SideWinder::decode, {
+		{0x08, 0x01, 0x00, 0x00, 0x00},
+		{0x08, 0x00, 0x00, 0x00, 0x00}
+	});
+
+	// all 30 macro keys pressed and released at once
+	addDecoder(bench, "sidewinder/all", SideWinder::decode, {
+		{0x08, 0xff, 0xff, 0xff, 0x3f},
+		{0x08, 0x00, 0x00, 0x00, 0x00}
+	});
+
+	// media key, e.g. Bank Switch
+	addDecoder(bench, "sidewinder/extra", SideWinder::decode, {
+		{0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x14, 0x00},
+		{0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
+	});
+
+	addDecoder(bench, "g103/all", LogitechG103::decode, {
+		{0x03, 0x3f, 0x00},
+		{0x03, 0x00, 0x00}
+	});
+
+	addDecoder(bench, "g105/all", LogitechG105::decode, {
+		{0x03, 0x3f, 0x0f},
+		{0x03, 0x00, 0x00}
+	});
+
+	addDecoder(bench, "g710/all", LogitechG710::decode, {
+		{0x03, 0x3f, 0xf0, 0x00},
+		{0x03, 0x00, 0x00, 0x00}
+	});
+}
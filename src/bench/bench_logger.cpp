@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include <core/logger.hpp>
+
+#include "bench.hpp"
+
+void addLoggerBenchmarks(Bench *bench) {
+	// formatting and writing happen on the drain thread, output is discarded
+	if (Logger::get()->openFile("/dev/null")) {
+		std::cerr << "Can't open /dev/null." << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
+	Logger::get()->setLevel(LogLevel::Info);
+	Logger::get()->start();
+
+	bench->add("log/filtered", []() {
+		LOGGER_DEBUG("getFeatureReport(%d) returned: %x %x", 7, 7, 1);
+	});
+
+	/*
+	 * a tight loop outruns the drain thread. Timing stops before the ring is
+	 * full and restarting the drain thread empties it, so no message is
+	 * dropped.
+	 */
+	bench->add("log/enabled", []() {
+		LOGGER_INFO("Found device: %s:%s (%s)", "045e", "074b", "/sys/devices/pci0000:00/usb1/1-1");
+	}, LOG_RING_SIZE, []() {
+		Logger::get()->stop();
+		Logger::get()->start();
+	});
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <core/macro.hpp>
+#include <core/macro_cache.hpp>
+
+#include "bench.hpp"
+
+/* constants */
+constexpr auto SMALL_MACRO_EVENTS =	16;
+constexpr auto LARGE_MACRO_EVENTS =	4096;
+
+/*
+ * Writes XML and binary macro files with alternating key presses and
+ * releases into a temporary directory.
+ */
+static std::string createMacro(std::string directory, std::string name, int nEvents) {
+	Macro macro;
+
+	for (int i = 0; i < nEvents; i++) {
+		macro.push_back(MacroEvent{EV_KEY, static_cast<uint16_t>(KEY_A + (i / 2) % 26), (i + 1) % 2, 10});
+	}
+
+	auto path = directory + "/" + name + ".xml";
+	auto binPath = Macro::getBinaryPath(path);
+
+	if (macro.saveXml(path) || macro.saveBinary(binPath)) {
+		std::cerr << "Can't write " << path << "." << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
+	return path;
+}
+
+static void addMacro(Bench *bench, std::string directory, std::string name, int nEvents) {
+	auto path = createMacro(directory, name, nEvents);
+	auto binPath = Macro::getBinaryPath(path);
+	auto cache = std::make_shared<MacroCache>(LARGE_MACRO_EVENTS * 2);
+
+	bench->add("macro/xml/" + name, [path]() {
+		Macro macro;
+		macro.loadXml(path);
+	});
+
+	bench->add("macro/binary/" + name, [binPath]() {
+		Macro macro;
+		macro.loadBinary(binPath);
+	});
+
+	// key press with a warm cache, including the modification checks
+	bench->add("macro/cached/" + name, [cache, path]() {
+		cache->get(path);
+	});
+}
+
+void addMacroBenchmarks(Bench *bench) {
+	char directory[] = "/tmp/sidewinderd-bench-XXXXXX";
+
+	if (!mkdtemp(directory)) {
+		std::cerr << "Can't create temporary directory." << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
+	addMacro(bench, directory, "small", SMALL_MACRO_EVENTS);
+	addMacro(bench, directory, "large", LARGE_MACRO_EVENTS);
+}
@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <core/device.hpp>
+#include <core/virtual_input.hpp>
+
+#include "bench.hpp"
+
+/* constants */
+constexpr auto FRAME_EVENTS =	8;
+constexpr auto UINPUT_ENV =	"SIDEWINDERD_BENCH_UINPUT";
+
+void addVirtualInputBenchmarks(Bench *bench) {
+	// /dev/null stands in for uinput, so only our own overhead is measured
+	int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		std::cerr << "Can't open /dev/null." << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
+	auto virtInput = std::make_shared<VirtualInput>(fd);
+
+	bench->add("uinput/event", [virtInput]() {
+		virtInput->sendEvent(EV_KEY, KEY_A, 1);
+	});
+
+	auto frame = std::make_shared<InputFrame>();
+
+	bench->add("uinput/frame", [virtInput, frame]() {
+		for (int i = 0; i < FRAME_EVENTS; i++) {
+			frame->add(EV_KEY, KEY_A + i, 1);
+		}
+
+		virtInput->sendFrame(frame.get());
+	});
+
+	/*
+	 * device creation sits on the hotplug path. Every iteration on uinput
+	 * creates a device, flooding udev with hotplug events, so it's opt-in.
+	 * By default, the ioctls fail on /dev/null, which still measures their
+	 * count.
+	 */
+	auto device = std::make_shared<Device>(Device{"045e", "074b", "Microsoft SideWinder X6", Device::Driver::SideWinder});
+	auto path = "/dev/null";
+
+	if (std::getenv(UINPUT_ENV)) {
+		if (access("/dev/uinput", W_OK)) {
+			std::cerr << "Can't access /dev/uinput, creating on /dev/null." << std::endl;
+		} else {
+			path = "/dev/uinput";
+		}
+	}
+
+	auto keys = std::make_shared<std::vector<KeyRange>>();
+	VirtualInput::parseKeys("2-11,30", keys.get());
+
+	bench->add("uinput/create", [device, path]() {
+		int fd = open(path, O_WRONLY | O_CLOEXEC);
+		VirtualInput::setup(fd, device.get(), std::vector<KeyRange>());
+		close(fd);
+	});
+
+	bench->add("uinput/create_few_keys", [device, path, keys]() {
+		int fd = open(path, O_WRONLY | O_CLOEXEC);
+		VirtualInput::setup(fd, device.get(), *keys);
+		close(fd);
+	});
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "bench.hpp"
+
+std::atomic<unsigned long long> allocations(0);
+
+/*
+ * counting every heap allocation, the benchmarks are run single threaded, but
+ * worker threads of the daemon might allocate as well
+ */
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void *ptr = std::malloc(size ? size : 1)) {
+		return ptr;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc > 2) {
+		std::cerr << "Usage: " << argv[0] << " [filter]" << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	std::string filter;
+
+	if (argc == 2) {
+		filter = argv[1];
+	}
+
+	Bench bench;
+	addInputBenchmarks(&bench);
+	addMacroBenchmarks(&bench);
+	addVirtualInputBenchmarks(&bench);
+	addDeviceManagerBenchmarks(&bench);
+	addControlBenchmarks(&bench);
+	addLoggerBenchmarks(&bench);
+
+	if (!bench.run(filter)) {
+		std::cerr << "No benchmark matches " << filter << "." << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <libudev.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+#include "udev_mock.hpp"
+
+/* constants */
+constexpr auto MOCK_USB_PATH =		"/sys/devices/pci0000:00/0000:00:14.0/usb1/";
+constexpr auto MOCK_VENDOR =		"046d";
+constexpr auto MOCK_PRODUCT_BASE =	0x1000;
+
+struct udev_device {
+	std::string sysPath;
+	std::string sysName;
+	std::string subsystem;
+	std::string devNode;
+	std::map<std::string, std::string> sysAttrs;
+	std::map<std::string, std::string> properties;
+	struct udev_device *usbDevice;
+	struct udev_device *usbInterface;
+};
+
+struct udev_list_entry {
+	std::string name;
+	struct udev_list_entry *next;
+};
+
+struct udev_enumerate {
+	std::vector<std::string> subsystems;
+	std::vector<struct udev_list_entry> entries;
+};
+
+struct udev_monitor {
+	int fd;
+};
+
+static int instance;
+static std::size_t nTreeDevices;
+static std::vector<std::unique_ptr<struct udev_device>> tree;
+static std::map<std::string, struct udev_device *> bySysPath;
+
+static struct udev_device *addNode(std::string sysPath, std::string subsystem, std::string devNode,
+		struct udev_device *usbDevice, struct udev_device *usbInterface) {
+	std::unique_ptr<struct udev_device> dev(new udev_device());
+	dev->sysPath = sysPath;
+	dev->sysName = sysPath.substr(sysPath.rfind('/') + 1);
+	dev->subsystem = subsystem;
+	dev->devNode = devNode;
+	dev->usbDevice = usbDevice;
+	dev->usbInterface = usbInterface;
+	auto node = dev.get();
+	bySysPath[sysPath] = node;
+	tree.push_back(std::move(dev));
+
+	return node;
+}
+
+/*
+ * Adds a USB device with a hidraw node and an input device on interface 00.
+ */
+static void addUsbDevice(std::size_t i, std::string vendor, std::string product) {
+	auto port = "1-" + std::to_string(i + 1);
+	auto usbPath = MOCK_USB_PATH + port;
+	auto interfacePath = usbPath + "/" + port + ":1.0";
+	auto usb = addNode(usbPath, "usb", "", nullptr, nullptr);
+	usb->sysAttrs["idVendor"] = vendor;
+	usb->sysAttrs["idProduct"] = product;
+	usb->sysAttrs["serial"] = "MOCK" + std::to_string(i);
+	auto interface = addNode(interfacePath, "usb", "", usb, nullptr);
+	interface->sysAttrs["bInterfaceNumber"] = "00";
+
+	auto hidraw = std::to_string(i);
+	addNode(interfacePath + "/hidraw/hidraw" + hidraw, "hidraw", "/dev/hidraw" + hidraw, usb, interface);
+
+	// input devices have no device node, only their event nodes have
+	auto inputPath = interfacePath + "/input/input" + std::to_string(i);
+	addNode(inputPath, "input", "", usb, interface);
+	auto event = addNode(inputPath + "/event" + std::to_string(i), "input",
+			"/dev/input/event" + std::to_string(i), usb, interface);
+	event->properties["ID_USB_INTERFACE_NUM"] = "00";
+	event->properties["ID_INPUT_KEYBOARD"] = "1";
+	event->properties["ID_VENDOR_ID"] = vendor;
+	event->properties["ID_MODEL_ID"] = product;
+}
+
+/*
+ * Adds unsupported USB devices and a single SideWinder.
+ */
+static void build(std::size_t nDevices) {
+	for (std::size_t i = 0; i < nDevices; i++) {
+		char product[5];
+		std::snprintf(product, sizeof(product), "%04zx", MOCK_PRODUCT_BASE + i);
+		addUsbDevice(i, MOCK_VENDOR, product);
+	}
+
+	if (nDevices) {
+		// keyboard interface of a SideWinder, macro keys use interface 01
+		addUsbDevice(nDevices, "045e", "074b");
+		tree.back()->properties.erase("ID_INPUT_KEYBOARD");
+	}
+}
+
+std::size_t createDeviceTree(std::size_t nDevices) {
+	if (tree.empty() || nDevices != nTreeDevices) {
+		tree.clear();
+		bySysPath.clear();
+		nTreeDevices = nDevices;
+		build(nDevices);
+	}
+
+	// USB devices and interfaces are parents only, they aren't enumerated
+	return std::count_if(tree.begin(), tree.end(), [](const std::unique_ptr<struct udev_device> &dev) {
+		return dev->subsystem != "usb";
+	});
+}
+
+struct udev *udev_new(void) {
+	return reinterpret_cast<struct udev *>(&instance);
+}
+
+struct udev *udev_unref(struct udev *) {
+	return nullptr;
+}
+
+struct udev_monitor *udev_monitor_new_from_netlink(struct udev *, const char *) {
+	auto monitor = new udev_monitor();
+	monitor->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	return monitor;
+}
+
+int udev_monitor_filter_add_match_subsystem_devtype(struct udev_monitor *, const char *, const char *) {
+	return 0;
+}
+
+int udev_monitor_set_receive_buffer_size(struct udev_monitor *, int) {
+	return 0;
+}
+
+int udev_monitor_enable_receiving(struct udev_monitor *) {
+	return 0;
+}
+
+int udev_monitor_get_fd(struct udev_monitor *monitor) {
+	return monitor->fd;
+}
+
+struct udev_device *udev_monitor_receive_device(struct udev_monitor *) {
+	return nullptr;
+}
+
+struct udev_monitor *udev_monitor_unref(struct udev_monitor *monitor) {
+	close(monitor->fd);
+	delete monitor;
+
+	return nullptr;
+}
+
+struct udev_enumerate *udev_enumerate_new(struct udev *) {
+	return new udev_enumerate();
+}
+
+int udev_enumerate_add_match_subsystem(struct udev_enumerate *enumerate, const char *subsystem) {
+	enumerate->subsystems.push_back(subsystem);
+
+	return 0;
+}
+
+int udev_enumerate_scan_devices(struct udev_enumerate *enumerate) {
+	enumerate->entries.clear();
+
+	for (auto &dev : tree) {
+		for (auto &subsystem : enumerate->subsystems) {
+			if (dev->subsystem == subsystem) {
+				enumerate->entries.push_back(udev_list_entry{dev->sysPath, nullptr});
+			}
+		}
+	}
+
+	for (std::size_t i = 1; i < enumerate->entries.size(); i++) {
+		enumerate->entries[i - 1].next = &enumerate->entries[i];
+	}
+
+	return 0;
+}
+
+struct udev_list_entry *udev_enumerate_get_list_entry(struct udev_enumerate *enumerate) {
+	return enumerate->entries.empty() ? nullptr : &enumerate->entries.front();
+}
+
+struct udev_enumerate *udev_enumerate_unref(struct udev_enumerate *enumerate) {
+	delete enumerate;
+
+	return nullptr;
+}
+
+struct udev_list_entry *udev_list_entry_get_next(struct udev_list_entry *entry) {
+	return entry->next;
+}
+
+const char *udev_list_entry_get_name(struct udev_list_entry *entry) {
+	return entry->name.c_str();
+}
+
+struct udev_device *udev_device_new_from_syspath(struct udev *, const char *sysPath) {
+	auto it = bySysPath.find(sysPath);
+
+	return it == bySysPath.end() ? nullptr : it->second;
+}
+
+// devices belong to the tree
+struct udev_device *udev_device_unref(struct udev_device *) {
+	return nullptr;
+}
+
+struct udev_device *udev_device_get_parent_with_subsystem_devtype(struct udev_device *dev, const char *subsystem, const char *devType) {
+	if (std::strcmp(subsystem, "usb")) {
+		return nullptr;
+	}
+
+	return std::strcmp(devType, "usb_device") ? dev->usbInterface : dev->usbDevice;
+}
+
+static const char *get(const std::string &value) {
+	return value.empty() ? nullptr : value.c_str();
+}
+
+const char *udev_device_get_subsystem(struct udev_device *dev) {
+	return get(dev->subsystem);
+}
+
+const char *udev_device_get_devnode(struct udev_device *dev) {
+	return get(dev->devNode);
+}
+
+const char *udev_device_get_syspath(struct udev_device *dev) {
+	return get(dev->sysPath);
+}
+
+const char *udev_device_get_sysname(struct udev_device *dev) {
+	return get(dev->sysName);
+}
+
+// only enumerated, never received from the monitor
+const char *udev_device_get_action(struct udev_device *) {
+	return nullptr;
+}
+
+const char *udev_device_get_sysattr_value(struct udev_device *dev, const char *sysAttr) {
+	auto it = dev->sysAttrs.find(sysAttr);
+
+	return it == dev->sysAttrs.end() ? nullptr : it->second.c_str();
+}
+
+const char *udev_device_get_property_value(struct udev_device *dev, const char *key) {
+	auto it = dev->properties.find(key);
+
+	return it == dev->properties.end() ? nullptr : it->second.c_str();
+}
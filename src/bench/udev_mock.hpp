@@ -0,0 +1,27 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef UDEV_MOCK_H
+#define UDEV_MOCK_H
+
+#include <cstddef>
+
+/**
+ * Replaces the devices seen through libudev with a synthetic tree. Each USB
+ * device has a hidraw node, an input device and its event node. None of them
+ * is supported, apart from a single SideWinder, whose nodes are matched, but
+ * don't belong to the macro key interface, so no keyboard is set up.
+ *
+ * The benchmark executable defines all libudev functions used by the daemon,
+ * its definitions take precedence over the shared library. The tree is only
+ * rebuilt, if the number of devices changes.
+ * @param nDevices number of unsupported USB devices
+ * @return number of nodes in the tree
+ */
+std::size_t createDeviceTree(std::size_t nDevices);
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdint>
+
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include <core/blink_service.hpp>
+#include <core/led.hpp>
+#include <core/logger.hpp>
+#include <core/macro_scheduler.hpp>
+
+void BlinkService::start(Led *led, unsigned int onPeriod, unsigned int offPeriod) {
+	led->setLit(true);
+	std::lock_guard<std::mutex> lock(mutex_);
+	blinks_[led] = Blink{MacroScheduler::now() + onPeriod * NSEC_PER_MSEC, true, onPeriod, offPeriod};
+	arm();
+}
+
+void BlinkService::stop(Led *led) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (blinks_.erase(led)) {
+		arm();
+	}
+}
+
+void BlinkService::expire() {
+	uint64_t value;
+	read(timerfd_, &value, sizeof(value));
+	auto time = MacroScheduler::now();
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (auto &it : blinks_) {
+		auto &blink = it.second;
+
+		if (blink.deadline <= time) {
+			blink.isLit = !blink.isLit;
+			it.first->setLit(blink.isLit);
+			// deadlines are absolute, so the rhythm doesn't drift
+			blink.deadline += (blink.isLit ? blink.onPeriod : blink.offPeriod) * NSEC_PER_MSEC;
+
+			if (blink.deadline <= time) {
+				blink.deadline = time;
+			}
+		}
+	}
+
+	arm();
+}
+
+/*
+ * Arms timerfd with the earliest deadline or disarms it, if no LED is blinking.
+ */
+void BlinkService::arm() {
+	struct itimerspec spec = itimerspec();
+	long long deadline = 0;
+
+	for (auto &it : blinks_) {
+		if (!deadline || it.second.deadline < deadline) {
+			deadline = it.second.deadline;
+		}
+	}
+
+	spec.it_value.tv_sec = deadline / NSEC_PER_SEC;
+	spec.it_value.tv_nsec = deadline % NSEC_PER_SEC;
+	timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+BlinkService::BlinkService(Reactor *reactor) {
+	reactor_ = reactor;
+	timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+	if (timerfd_ < 0) {
+		LOGGER_ERROR("Can't create blink timer.");
+	}
+
+	reactor_->add(timerfd_, EPOLLIN, [this](uint32_t) { expire(); });
+}
+
+BlinkService::~BlinkService() {
+	reactor_->remove(timerfd_);
+	close(timerfd_);
+}
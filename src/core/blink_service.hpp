@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef BLINK_SERVICE_CLASS_H
+#define BLINK_SERVICE_CLASS_H
+
+#include <map>
+#include <mutex>
+
+#include <core/reactor.hpp>
+
+class Led;
+
+/**
+ * Class emulating blinking LEDs in software.
+ *
+ * A single timerfd on the event loop drives all blinking LEDs of all devices,
+ * so blinking neither blocks nor needs any threads. LEDs can be started and
+ * stopped from any thread, e.g. while devices are set up in parallel.
+ */
+class BlinkService {
+	public:
+		/**
+		 * Starts blinking, beginning with the on period.
+		 * @param led LED to be blinked
+		 * @param onPeriod time in milliseconds, the LED is lit
+		 * @param offPeriod time in milliseconds, the LED is dark
+		 */
+		void start(Led *led, unsigned int onPeriod, unsigned int offPeriod);
+
+		/**
+		 * Stops blinking immediately. The LED state is left untouched.
+		 * @param led LED to be stopped
+		 */
+		void stop(Led *led);
+		BlinkService(Reactor *reactor);
+		~BlinkService();
+
+	private:
+		struct Blink {
+			long long deadline; /**< next toggle in nanoseconds */
+			bool isLit;
+			unsigned int onPeriod;
+			unsigned int offPeriod;
+		};
+
+		int timerfd_;
+		Reactor *reactor_;
+		std::map<Led *, Blink> blinks_;
+		std::mutex mutex_; /**< protects blinks_ */
+		void expire();
+		void arm();
+};
+
+#endif
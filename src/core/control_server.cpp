@@ -0,0 +1,264 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <core/logger.hpp>
+
+#include "control_server.hpp"
+
+constexpr auto MAX_CLIENTS =		16;
+constexpr auto MAX_LINE =		256;
+constexpr auto MAX_OUTPUT =		65536;
+constexpr auto MAX_KEY_INDEX =		32;
+constexpr auto RECEIVE_BUFFER_SIZE =	1024;
+
+int ControlServer::start(std::string path) {
+	struct sockaddr_un addr = sockaddr_un();
+	addr.sun_family = AF_UNIX;
+
+	if (path.size() >= sizeof(addr.sun_path)) {
+		LOGGER_ERROR("Control socket path is too long.");
+
+		return -1;
+	}
+
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (fd_ < 0) {
+		LOGGER_ERROR("Can't create control socket.");
+
+		return -1;
+	}
+
+	// a previous instance might not have cleaned up
+	unlink(path.c_str());
+
+	/*
+	 * the socket accepts commands without authentication, so only the user
+	 * running the daemon may connect
+	 */
+	mode_t mask = umask(S_IRWXG | S_IRWXO);
+	int ret = bind(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+	umask(mask);
+
+	if (ret || listen(fd_, MAX_CLIENTS)
+			|| reactor_->add(fd_, EPOLLIN, [this](uint32_t) { accept(); })) {
+		LOGGER_ERROR("Can't listen on control socket %s.", path.c_str());
+		close(fd_);
+		fd_ = -1;
+
+		return -1;
+	}
+
+	path_ = path;
+
+	return 0;
+}
+
+void ControlServer::stop() {
+	while (!clients_.empty()) {
+		drop(clients_.begin()->first);
+	}
+
+	if (fd_ >= 0) {
+		reactor_->remove(fd_);
+		close(fd_);
+		unlink(path_.c_str());
+		fd_ = -1;
+	}
+}
+
+void ControlServer::accept() {
+	int fd;
+
+	while ((fd = accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		if (clients_.size() >= MAX_CLIENTS) {
+			close(fd);
+			continue;
+		}
+
+		clients_[fd] = Client();
+		reactor_->add(fd, EPOLLIN, [this, fd](uint32_t events) { receive(fd, events); });
+	}
+}
+
+/*
+ * Reads all pending data and executes every complete command. Responses are
+ * collected and sent at once, so pipelined commands don't cost a write each.
+ */
+void ControlServer::receive(int fd, uint32_t events) {
+	auto it = clients_.find(fd);
+
+	if (it == clients_.end()) {
+		return;
+	}
+
+	auto &client = it->second;
+	bool isClosed = events & (EPOLLHUP | EPOLLERR);
+
+	if (events & EPOLLIN) {
+		char buf[RECEIVE_BUFFER_SIZE];
+		ssize_t nBytes;
+
+		while ((nBytes = read(fd, buf, sizeof(buf))) > 0) {
+			client.input.append(buf, nBytes);
+			std::size_t pos;
+
+			while ((pos = client.input.find('\n')) != std::string::npos) {
+				execute(client.input.substr(0, pos), &client.output);
+				client.input.erase(0, pos + 1);
+			}
+
+			// drop clients, which don't send line breaks or don't read
+			if (client.input.size() > MAX_LINE || client.output.size() > MAX_OUTPUT) {
+				drop(fd);
+
+				return;
+			}
+		}
+
+		if (!nBytes || (nBytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+			isClosed = true;
+		}
+	}
+
+	if (flush(fd, &client) || isClosed) {
+		drop(fd);
+	}
+}
+
+/*
+ * Sends as much output as possible. Remaining output is sent, once the socket
+ * becomes writable again.
+ */
+int ControlServer::flush(int fd, struct Client *client) {
+	std::size_t sent = 0;
+
+	while (sent < client->output.size()) {
+		ssize_t nBytes = send(fd, client->output.data() + sent,
+				client->output.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (nBytes < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+
+			return -1;
+		}
+
+		sent += nBytes;
+	}
+
+	client->output.erase(0, sent);
+
+	return reactor_->modify(fd, client->output.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT);
+}
+
+void ControlServer::drop(int fd) {
+	reactor_->remove(fd);
+	close(fd);
+	clients_.erase(fd);
+}
+
+void ControlServer::execute(const std::string &line, std::string *output) {
+	std::istringstream command(line);
+	std::ostringstream response;
+	std::string name;
+	command >> name;
+
+	if (name.empty()) {
+		return;
+	} else if (name == "list") {
+		int id = 0;
+
+		for (auto &keyboard : *keyboards_) {
+			auto device = keyboard.second->getDevice();
+			response << id++ << " " << device.vendor << ":" << device.product
+				<< " " << keyboard.second->getProfile() + 1
+				<< " " << device.name << "\n";
+		}
+
+		response << "ok\n";
+	} else if (name == "play" || name == "profile" || name == "record") {
+		int id = -1;
+		int profile = 0;
+		int index = 0;
+		command >> id;
+
+		if (name != "record") {
+			command >> profile;
+		}
+
+		if (name == "play") {
+			command >> index;
+		}
+
+		auto keyboard = getKeyboard(id);
+
+		if (command.fail()) {
+			response << "error invalid arguments\n";
+		} else if (!keyboard) {
+			response << "error unknown device\n";
+		} else if (name != "record" && (profile - 1 < MIN_PROFILE || profile - 1 >= MAX_PROFILE)) {
+			response << "error unknown profile\n";
+		} else if (name == "play" && (index <= 0 || index > MAX_KEY_INDEX)) {
+			response << "error unknown key\n";
+		} else if (name == "play" && keyboard->playMacro(profile - 1, index)) {
+			response << "error no macro\n";
+		} else if (name == "record" && keyboard->toggleRecordMode()) {
+			response << "error not supported\n";
+		} else {
+			if (name == "profile") {
+				keyboard->setProfile(profile - 1);
+			}
+
+			response << "ok\n";
+		}
+	} else {
+		response << "error unknown command\n";
+	}
+
+	output->append(response.str());
+}
+
+/*
+ * Devices are numbered by their position in the list of connected devices.
+ */
+Keyboard *ControlServer::getKeyboard(int id) {
+	if (id < 0) {
+		return nullptr;
+	}
+
+	for (auto &keyboard : *keyboards_) {
+		if (!id--) {
+			return keyboard.second.get();
+		}
+	}
+
+	return nullptr;
+}
+
+ControlServer::ControlServer(Reactor *reactor, std::map<std::string, std::unique_ptr<Keyboard>> *keyboards) {
+	reactor_ = reactor;
+	keyboards_ = keyboards;
+	fd_ = -1;
+}
+
+ControlServer::~ControlServer() {
+	stop();
+}
@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef CONTROL_SERVER_CLASS_H
+#define CONTROL_SERVER_CLASS_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <core/keyboard.hpp>
+#include <core/reactor.hpp>
+
+/**
+ * Class serving a local control socket.
+ *
+ * Clients send newline terminated commands over a UNIX stream socket and
+ * receive one or more response lines, terminated by "ok" or "error <reason>":
+ *
+ *	list				lists connected devices
+ *	play <device> <profile> <key>	plays macro of a key
+ *	profile <device> <profile>	switches active profile
+ *	record <device>			toggles record mode
+ *
+ * Devices are numbered in the order of the list command, profiles and keys
+ * start at 1. Everything runs on the event loop, so commands never race with
+ * key presses and a slow client can't block the daemon.
+ */
+class ControlServer {
+	public:
+		/**
+		 * Creates control socket and starts accepting clients.
+		 * @param path socket path, an existing socket is replaced
+		 * @return 0 on success, -1 on error
+		 */
+		int start(std::string path);
+
+		/**
+		 * Disconnects all clients and removes control socket.
+		 */
+		void stop();
+		ControlServer(Reactor *reactor, std::map<std::string, std::unique_ptr<Keyboard>> *keyboards);
+		~ControlServer();
+
+	private:
+		struct Client {
+			std::string input; /**< incomplete command */
+			std::string output; /**< responses, which haven't been sent yet */
+		};
+
+		int fd_; /**< listening socket */
+		std::string path_;
+		Reactor *reactor_;
+		std::map<std::string, std::unique_ptr<Keyboard>> *keyboards_;
+		std::map<int, Client> clients_; /**< keyed by file descriptor */
+		void accept();
+		void receive(int fd, uint32_t events);
+		int flush(int fd, struct Client *client);
+		void drop(int fd);
+		void execute(const std::string &line, std::string *output);
+		Keyboard *getKeyboard(int id);
+};
+
+#endif
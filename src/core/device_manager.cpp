@@ -5,10 +5,22 @@
  * MIT License. For more information, see LICENSE file.
  */
 
+#include <csignal>
+#include <cstdlib>
 #include <cstring>
-#include <iostream>
+#include <future>
+#include <sstream>
+#include <string>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 #include <core/device_manager.hpp>
+#include <core/logger.hpp>
 #include <vendor/logitech/g103.hpp>
 #include <vendor/logitech/g105.hpp>
 #include <vendor/logitech/g710.hpp>
@@ -16,120 +28,217 @@
 
 constexpr auto VENDOR_MICROSOFT =	"045e";
 constexpr auto VENDOR_LOGITECH =	"046d";
-constexpr auto TIMEOUT =		5000;
-constexpr auto NUM_POLL =		1;
+constexpr auto RECEIVE_BUFFER_SIZE =	128 * 1024 * 1024;
+
+/*
+ * Sets up all devices, which have been found completely. Setting up a device
+ * takes several blocking requests, e.g. for creating the virtual input device
+ * and initializing its LEDs, so multiple devices are set up in parallel.
+ * Creating a keyboard doesn't touch the event loop, which is locked while this
+ * runs as one of its callbacks. Keyboards are connected afterwards on this
+ * thread.
+ */
+void DeviceManager::bind() {
+	std::vector<Candidate> ready;
+
+	for (auto it = pending_.begin(); it != pending_.end();) {
+		auto candidate = it->second;
+		auto &device = candidate.device;
+		auto &devNode = candidate.devNode;
+
+		// wait, until both interfaces of the device have been found
+		if (devNode.hidraw.empty() || devNode.inputEvent.empty()) {
+			++it;
+			continue;
+		}
 
-void DeviceManager::discover() {
-	for (auto it : devices_) {
-		struct Device device = it;
-		struct sidewinderd::DevNode devNode;
+		it = pending_.erase(it);
+		LOGGER_INFO("Found device: %s:%s (%s)", device.vendor.c_str(),
+			device.product.c_str(), devNode.sysPath.c_str());
+		auto connected = connected_.find(devNode.sysPath);
 
-		if (probe(&device, &devNode) > 0) {
-			// TODO use a unique identifier
-			auto it = connected_.find(device.product);
+		if (connected != connected_.end()) {
+			// skip device, if it is already connected
+			if (connected->second->isConnected()) {
+				continue;
+			}
 
-			// skip this loop, if device is already connected
-			if (it != connected_.end()) {
+			// device has been replugged, before its removal was handled
+			if (!reattach(connected->second.get(), &devNode)) {
 				continue;
 			}
 
-			switch (device.driver) {
-				case Device::Driver::LogitechG103: {
-					auto keyboard = new LogitechG103(&device, &devNode, config_, process_);
-					keyboard->connect();
-					connected_[device.product] = std::unique_ptr<Keyboard>(keyboard);
-					break;
-				}
-				case Device::Driver::LogitechG105: {
-					auto keyboard = new LogitechG105(&device, &devNode, config_, process_);
-					keyboard->connect();
-					connected_[device.product] = std::unique_ptr<Keyboard>(keyboard);
-					break;
-				}
-				case Device::Driver::LogitechG710: {
-					auto keyboard = new LogitechG710(&device, &devNode, config_, process_);
-					keyboard->connect();
-					connected_[device.product] = std::unique_ptr<Keyboard>(keyboard);
-					break;
-				}
-				case Device::Driver::SideWinder: {
-					auto keyboard = new SideWinder(&device, &devNode, config_, process_);
-					keyboard->connect();
-					connected_[device.product] = std::unique_ptr<Keyboard>(keyboard);
-					break;
-				}
+			connected_.erase(connected);
+		}
+
+		// device has been replugged within its grace period
+		auto detached = detached_.find(getKey(device, devNode));
+
+		if (detached != detached_.end()) {
+			auto keyboard = std::move(detached->second.keyboard);
+			detached_.erase(detached);
+			arm();
+
+			if (!reattach(keyboard.get(), &devNode)) {
+				connected_[devNode.sysPath] = std::move(keyboard);
+				continue;
 			}
 		}
+
+		ready.push_back(candidate);
+	}
+
+	if (ready.empty()) {
+		return;
+	}
+
+	for (auto &candidate : ready) {
+		candidate.devNode.workdir = getWorkdir(candidate.device, candidate.devNode,
+				countDevices(candidate.device, ready) == 1);
+	}
+
+	// a single device is set up right away, without starting a thread
+	auto policy = ready.size() > 1 ? std::launch::async : std::launch::deferred;
+	std::vector<std::future<Keyboard *>> keyboards;
+	std::vector<long long> created(ready.size());
+	auto start = MacroScheduler::now();
+
+	for (std::size_t i = 0; i < ready.size(); i++) {
+		keyboards.push_back(std::async(policy, [this, &ready, &created, i]() {
+			auto begin = MacroScheduler::now();
+			auto keyboard = createKeyboard(&ready[i].device, &ready[i].devNode, settingsStore_, process_, &reactor_, &blinkService_);
+			created[i] = MacroScheduler::now() - begin;
+
+			return keyboard;
+		}));
+	}
+
+	for (std::size_t i = 0; i < ready.size(); i++) {
+		auto keyboard = keyboards[i].get();
+		auto begin = MacroScheduler::now();
+		keyboard->connect();
+		auto connected = MacroScheduler::now() - begin;
+		connected_[ready[i].devNode.sysPath] = std::unique_ptr<Keyboard>(keyboard);
+		LOGGER_INFO("Set up %s in %lld us (create %lld us, connect %lld us).", ready[i].device.name.c_str(),
+			(created[i] + connected) / 1000, created[i] / 1000, connected / 1000);
+	}
+
+	if (ready.size() > 1) {
+		LOGGER_INFO("Set up %zu devices in %lld us.", ready.size(), (MacroScheduler::now() - start) / 1000);
 	}
 }
 
-int DeviceManager::monitor() {
-	// create udev object
-	udev_ = udev_new();
+/*
+ * Every keyboard keeps its profiles in its own directory, named after its
+ * serial number or USB port, so the directory doesn't depend on the order in
+ * which keyboards are plugged in. Profiles of earlier versions are stored in
+ * the top-level directory. They are adopted by a keyboard, which is the only
+ * one of its model, by linking its directory to the top-level directory.
+ */
+std::string DeviceManager::getWorkdir(const struct Device &device, const sidewinderd::DevNode &devNode, bool isAlone) {
+	auto prefix = device.vendor + "_" + device.product + "_";
+	auto workdir = prefix + devNode.id;
 
-	if (!udev_) {
-		std::cerr << "Can't create udev." << std::endl;
+	if (!isAlone || !access(workdir.c_str(), F_OK) || access("profile_1", F_OK)) {
+		return workdir + "/";
+	}
 
-		return -1;
+	// another keyboard of the same model has been configured before
+	DIR *dir = opendir(".");
+
+	if (!dir) {
+		return workdir + "/";
 	}
 
-	// set up monitor for /dev/hidraw and /dev/input/event*
-	monitor_ = udev_monitor_new_from_netlink(udev_, "udev");
-	udev_monitor_filter_add_match_subsystem_devtype(monitor_, "hidraw", NULL);
-	udev_monitor_filter_add_match_subsystem_devtype(monitor_, "input", NULL);
-	udev_monitor_enable_receiving(monitor_);
+	bool isConfigured = false;
+	struct dirent *entry;
 
-	// get file descriptor for the monitor, so we can use poll() on it
-	fd_ = udev_monitor_get_fd(monitor_);
+	while ((entry = readdir(dir))) {
+		if (!std::strncmp(entry->d_name, prefix.c_str(), prefix.size())) {
+			isConfigured = true;
+			break;
+		}
+	}
 
-	// setup poll
-	pfd_.fd = fd_;
-	pfd_.events = POLLIN;
+	closedir(dir);
 
-	// initial discovery of new devices
-	discover();
+	if (!isConfigured) {
+		if (symlink(".", workdir.c_str())) {
+			LOGGER_ERROR("Can't link %s to top-level profiles.", workdir.c_str());
+		} else {
+			LOGGER_INFO("Linked %s to top-level profiles.", workdir.c_str());
+		}
+	}
 
-	struct udev_device *dev;
+	return workdir + "/";
+}
 
-	// run monitoring loop, until we receive a signal
-	while (process_->isActive()) {
-		poll(&pfd_, NUM_POLL, TIMEOUT);
-		dev = udev_monitor_receive_device(monitor_);
+/*
+ * Counts keyboards of the same model, which are connected, unplugged within
+ * their grace period or about to be set up.
+ */
+std::size_t DeviceManager::countDevices(const struct Device &device, const std::vector<Candidate> &ready) {
+	std::size_t nDevices = 0;
 
-		if (dev) {
-			// filter out nullptr returns, else std::string() fails
-			auto ret = udev_device_get_action(dev);
+	for (auto &keyboard : connected_) {
+		auto other = keyboard.second->getDevice();
+		nDevices += other.vendor == device.vendor && other.product == device.product;
+	}
 
-			if (ret) {
-				std::string action(ret);
+	for (auto &keyboard : detached_) {
+		auto other = keyboard.second.keyboard->getDevice();
+		nDevices += other.vendor == device.vendor && other.product == device.product;
+	}
 
-				if (action == "add") {
-					discover();
-				} else if (action == "remove") {
-					// check for disconnected devices
-					auto product = udev_device_get_property_value(dev, "ID_MODEL_ID");
+	for (auto &other : ready) {
+		nDevices += other.device.vendor == device.vendor && other.device.product == device.product;
+	}
 
-					if (product) {
-						unbind(product);
-					}
-				}
-			}
+	return nDevices;
+}
 
-			udev_device_unref(dev);
-		}
+/*
+ * Hands the nodes of a replugged device to its keyboard, which only needs to
+ * reopen hidraw. Macros are still cached, so the next key press is served as
+ * fast as before unplugging.
+ */
+int DeviceManager::reattach(Keyboard *keyboard, sidewinderd::DevNode *devNode) {
+	auto start = MacroScheduler::now();
+
+	if (keyboard->reattach(devNode)) {
+		return -1;
 	}
 
-	udev_monitor_unref(monitor_);
-	udev_unref(udev_);
+	LOGGER_INFO("Reattached %s in %lld us.", keyboard->getDevice().name.c_str(), (MacroScheduler::now() - start) / 1000);
 
 	return 0;
 }
 
-int DeviceManager::probe(struct Device *device, struct sidewinderd::DevNode *devNode) {
-	struct udev_device *dev;
+Keyboard *DeviceManager::createKeyboard(struct Device *device,
+		sidewinderd::DevNode *devNode, SettingsStore *settingsStore,
+		Process *process, Reactor *reactor, BlinkService *blinkService) {
+	switch (device->driver) {
+		case Device::Driver::LogitechG103:
+			return new LogitechG103(device, devNode, settingsStore, process, reactor, blinkService);
+		case Device::Driver::LogitechG105:
+			return new LogitechG105(device, devNode, settingsStore, process, reactor, blinkService);
+		case Device::Driver::LogitechG710:
+			return new LogitechG710(device, devNode, settingsStore, process, reactor, blinkService);
+		case Device::Driver::SideWinder:
+			return new SideWinder(device, devNode, settingsStore, process, reactor, blinkService);
+	}
+
+	return nullptr;
+}
+
+/*
+ * Enumerates hidraw and input subsystems once and matches every node against
+ * the index of supported devices.
+ */
+void DeviceManager::discover() {
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *devices, *entry;
-	bool isFound = false;
+	auto start = MacroScheduler::now();
 
 	// create a list of devices in hidraw and input subsystems
 	enumerate = udev_enumerate_new(udev_);
@@ -139,72 +248,168 @@ int DeviceManager::probe(struct Device *device, struct sidewinderd::DevNode *dev
 	devices = udev_enumerate_get_list_entry(enumerate);
 
 	udev_list_entry_foreach(entry, devices) {
-		const char *sysPath, *devNodePath;
-		sysPath = udev_list_entry_get_name(entry);
-		dev = udev_device_new_from_syspath(udev_, sysPath);
-		auto hidraw = udev_device_get_subsystem(dev);
-
-		// evaluation from left to right; used to filter out nullptr
-		if (hidraw && std::string(hidraw) == std::string("hidraw")) {
-			devNodePath = udev_device_get_devnode(dev);
-			dev = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_interface");
-
-			if (!dev) {
-				std::cerr << "Unable to find parent device." << std::endl;
-			}
+		auto dev = udev_device_new_from_syspath(udev_, udev_list_entry_get_name(entry));
+
+		if (dev) {
+			probe(dev);
+			udev_device_unref(dev);
+		}
+	}
 
-			auto bInterfaceNumber = udev_device_get_sysattr_value(dev, "bInterfaceNumber");
+	/* free the enumerator object */
+	udev_enumerate_unref(enumerate);
+	LOGGER_DEBUG("Scanned devices in %lld us.", (MacroScheduler::now() - start) / 1000);
 
-			if (bInterfaceNumber && std::string(bInterfaceNumber) == std::string("01")) {
-				dev = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
-				auto idVendor = udev_device_get_sysattr_value(dev, "idVendor");
-				auto idProduct = udev_device_get_sysattr_value(dev, "idProduct");
+	bind();
+}
 
-				if (idVendor && std::string(idVendor) == device->vendor
-					&& idProduct && std::string(idProduct) == device->product) {
-						devNode->hidraw = devNodePath;
-				}
-			}
+int DeviceManager::monitor() {
+	if (!udev_) {
+		LOGGER_ERROR("Can't create udev.");
+
+		return -1;
+	}
+
+	// set up monitor for /dev/hidraw and /dev/input/event*
+	monitor_ = udev_monitor_new_from_netlink(udev_, "udev");
+	udev_monitor_filter_add_match_subsystem_devtype(monitor_, "hidraw", NULL);
+	udev_monitor_filter_add_match_subsystem_devtype(monitor_, "input", NULL);
+
+	// large enough to hold event bursts, needs root privileges
+	process_->privilege();
+	udev_monitor_set_receive_buffer_size(monitor_, RECEIVE_BUFFER_SIZE);
+	process_->unprivilege();
+
+	udev_monitor_enable_receiving(monitor_);
+
+	// get file descriptor for the monitor, so we can add it to the event loop
+	fd_ = udev_monitor_get_fd(monitor_);
+	reactor_.add(fd_, EPOLLIN, [this](uint32_t) { receive(); });
+
+	// signals are delivered through the event loop as well
+	sigfd_ = process_->createSignalFd();
+	reactor_.add(sigfd_, EPOLLIN, [this](uint32_t) { handleSignals(); });
+
+	// configuration changes are applied without reconnecting devices
+	settingsStore_->watch(&reactor_);
+
+	// the working directory is the current directory at this point
+	auto controlSocket = settingsStore_->get()->controlSocket;
+
+	if (!controlSocket.empty()) {
+		control_.start(controlSocket);
+	}
+
+	// initial discovery of new devices
+	discover();
+
+	// run event loop, until we receive a signal
+	if (process_->isActive()) {
+		reactor_.run();
+	}
+
+	// remove all connected devices, while the event loop is still valid
+	control_.stop();
+	connected_.clear();
+	detached_.clear();
+	settingsStore_->unwatch();
+	reactor_.remove(sigfd_);
+	reactor_.remove(fd_);
+	close(sigfd_);
+
+	udev_monitor_unref(monitor_);
+	monitor_ = nullptr;
+
+	return 0;
+}
+
+/*
+ * Drains all pending udev events at once. Bursts of events, e.g. when a dock
+ * comes up, are deduplicated by device and handled in a single pass.
+ */
+void DeviceManager::receive() {
+	struct Event {
+		bool isAdded;
+		bool isRemoved;
+		struct udev_device *dev;
+	};
+
+	std::map<std::string, Event> events;
+	struct udev_device *dev;
+
+	while ((dev = udev_monitor_receive_device(monitor_))) {
+		// filter out nullptr returns, else std::string() fails
+		auto action = udev_device_get_action(dev);
+		auto sysPath = udev_device_get_syspath(dev);
+
+		if (!action || !sysPath) {
+			udev_device_unref(dev);
+			continue;
 		}
 
-		auto input = udev_device_get_subsystem(dev);
-		auto product = udev_device_get_property_value(dev, "ID_MODEL_ID");
-		auto vendor = udev_device_get_property_value(dev, "ID_VENDOR_ID");
-		auto interface = udev_device_get_property_value(dev, "ID_USB_INTERFACE_NUM");
+		auto &event = events[sysPath];
 
-		/* find correct /dev/input/event* file */
-		if (input && std::string(input) == std::string("input")
-			&& product && std::string(product) == device->product
-			&& vendor && std::string(vendor) == device->vendor
-			&& interface && std::string(interface) == "00"
-			&& udev_device_get_property_value(dev, "ID_INPUT_KEYBOARD")
-			&& strstr(sysPath, "event")
-			&& udev_device_get_parent_with_subsystem_devtype(dev, "usb", NULL)) {
-				devNode->inputEvent = udev_device_get_devnode(dev);
-				std::clog << "Found device: " << device->vendor << ":" << device->product << std::endl;
-				isFound = true;
+		if (event.dev) {
+			udev_device_unref(event.dev);
 		}
 
-		udev_device_unref(dev);
+		// only the latest action counts, but a removal must not get lost
+		event.dev = dev;
+
+		if (!std::strcmp(action, "add")) {
+			event.isAdded = true;
+		} else if (!std::strcmp(action, "remove")) {
+			event.isAdded = false;
+			event.isRemoved = true;
+		}
 	}
 
-	/* free the enumerator object */
-	udev_enumerate_unref(enumerate);
+	// handle removals first, so replugged devices are bound again
+	for (auto it : events) {
+		if (it.second.isRemoved) {
+			forget(it.first);
+			unbind(it.first);
+		}
+	}
+
+	bool isFound = false;
 
-	return isFound;
+	for (auto it : events) {
+		if (it.second.isAdded && probe(it.second.dev)) {
+			isFound = true;
+		}
+
+		udev_device_unref(it.second.dev);
+	}
+
+	if (isFound) {
+		bind();
+	}
 }
 
-void DeviceManager::unbind(std::string product) {
-	auto it = connected_.find(product);
+const struct Device *DeviceManager::match(const char *vendor, const char *product) {
+	// built once, never modified afterwards
+	static const auto devices = indexDevices();
+
+	if (!vendor || !product) {
+		return nullptr;
+	}
+
+	auto it = devices.find(getDeviceId(vendor, product));
 
-	if (it != connected_.end() && it->second->isConnected()) {
-		connected_.erase(product);
+	if (it == devices.end()) {
+		return nullptr;
 	}
+
+	return &it->second;
 }
 
-DeviceManager::DeviceManager(libconfig::Config *config, Process *process) {
+/*
+ * Indexes supported devices by vendor and product id.
+ */
+std::unordered_map<unsigned int, Device> DeviceManager::indexDevices() {
 	// list of supported devices
-	devices_ = {
+	std::vector<Device> devices = {
 		{VENDOR_MICROSOFT, "074b", "Microsoft SideWinder X6",
 			Device::Driver::SideWinder},
 		{VENDOR_MICROSOFT, "0768", "Microsoft SideWinder X4",
@@ -216,16 +421,272 @@ DeviceManager::DeviceManager(libconfig::Config *config, Process *process) {
 		{VENDOR_LOGITECH, "c24d", "Logitech G710+",
 			Device::Driver::LogitechG710}
 	};
+	std::unordered_map<unsigned int, Device> index;
+
+	for (auto device : devices) {
+		index[getDeviceId(device.vendor.c_str(), device.product.c_str())] = device;
+	}
+
+	return index;
+}
+
+unsigned int DeviceManager::getDeviceId(const char *vendor, const char *product) {
+	auto id = std::strtoul(vendor, nullptr, 16) << 16;
+	id |= std::strtoul(product, nullptr, 16) & 0xffff;
+
+	return id;
+}
+
+/*
+ * Returns the pending entry of a USB device, creating it if needed. The sysfs
+ * path of the USB device is used as a unique identifier.
+ */
+struct DeviceManager::Candidate &DeviceManager::addCandidate(struct udev_device *usb, const struct Device *device) {
+	std::string sysPath = udev_device_get_syspath(usb);
+	auto &candidate = pending_[sysPath];
+	candidate.device = *device;
+	candidate.devNode.sysPath = sysPath;
+
+	// prefer serial number for naming, fall back to USB port
+	auto serial = udev_device_get_sysattr_value(usb, "serial");
+	auto sysName = udev_device_get_sysname(usb);
+
+	if (serial && *serial) {
+		candidate.devNode.id = serial;
+	} else if (sysName) {
+		candidate.devNode.id = sysName;
+	}
+
+	return candidate;
+}
+
+/*
+ * Inspects a single hidraw or input node. Nodes of supported devices are
+ * collected by their parent USB device, until both interfaces have been found.
+ */
+int DeviceManager::probe(struct udev_device *dev) {
+	auto subsystem = udev_device_get_subsystem(dev);
+	auto devNodePath = udev_device_get_devnode(dev);
+
+	// evaluation from left to right; used to filter out nullptr
+	if (!subsystem || !devNodePath) {
+		return 0;
+	}
+
+	if (!std::strcmp(subsystem, "hidraw")) {
+		auto usb = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+
+		if (!usb) {
+			return 0;
+		}
+
+		auto device = match(udev_device_get_sysattr_value(usb, "idVendor"),
+				udev_device_get_sysattr_value(usb, "idProduct"));
+
+		if (!device) {
+			return 0;
+		}
+
+		// macro keys are reported on the second interface
+		auto interface = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_interface");
+
+		if (!interface) {
+			LOGGER_ERROR("Unable to find parent device.");
+
+			return 0;
+		}
+
+		auto bInterfaceNumber = udev_device_get_sysattr_value(interface, "bInterfaceNumber");
+
+		if (bInterfaceNumber && !std::strcmp(bInterfaceNumber, "01")) {
+			auto &candidate = addCandidate(usb, device);
+			candidate.devNode.hidraw = devNodePath;
+
+			return 1;
+		}
+	} else if (!std::strcmp(subsystem, "input")) {
+		auto sysName = udev_device_get_sysname(dev);
+		auto interface = udev_device_get_property_value(dev, "ID_USB_INTERFACE_NUM");
+
+		/* find correct /dev/input/event* file */
+		if (!sysName || std::strncmp(sysName, "event", 5)
+				|| !interface || std::strcmp(interface, "00")
+				|| !udev_device_get_property_value(dev, "ID_INPUT_KEYBOARD")) {
+			return 0;
+		}
 
-	config_ = config;
+		auto device = match(udev_device_get_property_value(dev, "ID_VENDOR_ID"),
+				udev_device_get_property_value(dev, "ID_MODEL_ID"));
+
+		if (!device) {
+			return 0;
+		}
+
+		auto usb = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+
+		if (usb) {
+			auto &candidate = addCandidate(usb, device);
+			candidate.devNode.inputEvent = devNodePath;
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * SIGUSR1 dumps latency statistics of all connected devices, any other signal
+ * stops the daemon.
+ */
+void DeviceManager::handleSignals() {
+	struct signalfd_siginfo info;
+
+	while (read(sigfd_, &info, sizeof(info)) == sizeof(info)) {
+		if (info.ssi_signo == SIGUSR1) {
+			for (auto &keyboard : connected_) {
+				auto device = keyboard.second->getDevice();
+				std::stringstream stats;
+				keyboard.second->getStats()->dump(&stats);
+				LOGGER_INFO("Latency of %s (%s):", device.name.c_str(), keyboard.first.c_str());
+
+				for (std::string line; std::getline(stats, line);) {
+					LOGGER_INFO("%s", line.c_str());
+				}
+			}
+
+			continue;
+		}
+
+		LOGGER_INFO("Stop signal received.");
+		process_->setActive(false);
+		reactor_.stop();
+	}
+}
+
+/*
+ * Checks, whether a sysfs path belongs to the given USB device.
+ */
+bool DeviceManager::isChild(const std::string &path, const std::string &parent) {
+	auto size = parent.size();
+
+	// removed node is the USB device itself or one of its children
+	return !path.compare(0, size, parent)
+		&& (path.size() == size || path[size] == '/');
+}
+
+/*
+ * Drops incomplete devices, which have been removed before both interfaces
+ * were found.
+ */
+void DeviceManager::forget(std::string sysPath) {
+	for (auto it = pending_.begin(); it != pending_.end();) {
+		if (isChild(sysPath, it->first)) {
+			it = pending_.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+/*
+ * Removes the keyboard, which the removed node belongs to. The device might
+ * have noticed the disconnect already. The keyboard is kept for the grace
+ * period, so its virtual input device doesn't vanish and a replug doesn't
+ * need to set it up again.
+ */
+void DeviceManager::unbind(std::string sysPath) {
+	auto gracePeriod = settingsStore_->get()->gracePeriod;
+
+	for (auto it = connected_.begin(); it != connected_.end();) {
+		if (!isChild(sysPath, it->first)) {
+			++it;
+			continue;
+		}
+
+		if (gracePeriod > 0) {
+			auto &keyboard = it->second;
+			keyboard->detach();
+			auto key = getKey(keyboard->getDevice(), keyboard->getDevNode());
+			LOGGER_INFO("Keeping %s for %d s.", keyboard->getDevice().name.c_str(), gracePeriod);
+			detached_[key] = Detached{std::move(keyboard), MacroScheduler::now() + gracePeriod * NSEC_PER_SEC};
+		}
+
+		it = connected_.erase(it);
+	}
+
+	arm();
+}
+
+/*
+ * Releases keyboards, whose grace period has expired.
+ */
+void DeviceManager::expire() {
+	uint64_t value;
+	read(timerfd_, &value, sizeof(value));
+	auto time = MacroScheduler::now();
+
+	for (auto it = detached_.begin(); it != detached_.end();) {
+		if (it->second.deadline <= time) {
+			LOGGER_INFO("Released %s.", it->second.keyboard->getDevice().name.c_str());
+			it = detached_.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	arm();
+}
+
+/*
+ * Arms timerfd with the earliest deadline or disarms it, if no keyboard is
+ * detached.
+ */
+void DeviceManager::arm() {
+	struct itimerspec spec = itimerspec();
+	long long deadline = 0;
+
+	for (auto &it : detached_) {
+		if (!deadline || it.second.deadline < deadline) {
+			deadline = it.second.deadline;
+		}
+	}
+
+	spec.it_value.tv_sec = deadline / NSEC_PER_SEC;
+	spec.it_value.tv_nsec = deadline % NSEC_PER_SEC;
+	timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+/*
+ * Identifies a device across replugs, even if it is plugged into another port.
+ */
+std::string DeviceManager::getKey(const struct Device &device, const sidewinderd::DevNode &devNode) {
+	return device.vendor + ":" + device.product + ":" + devNode.id;
+}
+
+DeviceManager::DeviceManager(SettingsStore *settingsStore, Process *process) :
+		blinkService_{&reactor_}, control_{&reactor_, &connected_} {
+	settingsStore_ = settingsStore;
 	process_ = process;
-	udev_ = nullptr;
+	udev_ = udev_new();
 	monitor_ = nullptr;
+	fd_ = -1;
+	sigfd_ = -1;
+	timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+	if (timerfd_ < 0) {
+		LOGGER_ERROR("Can't create grace period timer.");
+	}
+
+	reactor_.add(timerfd_, EPOLLIN, [this](uint32_t) { expire(); });
 }
 
 DeviceManager::~DeviceManager() {
 	// remove all connected devices
 	connected_.clear();
+	detached_.clear();
+	reactor_.remove(timerfd_);
+	close(timerfd_);
 
 	if (udev_) {
 		udev_unref(udev_);
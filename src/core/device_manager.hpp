@@ -10,36 +10,96 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <libudev.h>
-#include <poll.h>
-
-#include <libconfig.h++>
 
 #include <device_data.hpp>
 #include <process.hpp>
+#include <settings.hpp>
+#include <core/blink_service.hpp>
+#include <core/control_server.hpp>
 #include <core/device.hpp>
 #include <core/keyboard.hpp>
+#include <core/reactor.hpp>
 
 class DeviceManager {
 	public:
 		int monitor();
-		DeviceManager(libconfig::Config *config, Process *process);
+
+		/**
+		 * Enumerates hidraw and input nodes once and sets up all
+		 * supported devices, which have been found. Called by monitor()
+		 * on startup.
+		 */
+		void discover();
+
+		/**
+		 * Looks up a supported device. Can be called from any thread.
+		 * @param vendor USB vendor id, e.g. "045e"
+		 * @param product USB product id, e.g. "074b"
+		 * @return device or nullptr, if device isn't supported
+		 */
+		static const struct Device *match(const char *vendor, const char *product);
+
+		/**
+		 * Creates keyboard using the driver of the given device. The
+		 * keyboard isn't connected yet.
+		 * @return keyboard, which needs to be deleted by the caller
+		 */
+		static Keyboard *createKeyboard(struct Device *device, sidewinderd::DevNode *devNode, SettingsStore *settingsStore, Process *process, Reactor *reactor, BlinkService *blinkService);
+		DeviceManager(SettingsStore *settingsStore, Process *process);
 		~DeviceManager();
 
 	private:
-		int fd_;
-		std::map<std::string, std::unique_ptr<Keyboard>> connected_;
-		std::vector<Device> devices_;
-		struct pollfd pfd_;
+		/**
+		 * Struct collecting device nodes of a supported device, until
+		 * both interfaces have been found.
+		 */
+		struct Candidate {
+			struct Device device;
+			struct sidewinderd::DevNode devNode;
+		};
+
+		/**
+		 * Struct holding an unplugged keyboard, until it is replugged or
+		 * its grace period has expired.
+		 */
+		struct Detached {
+			std::unique_ptr<Keyboard> keyboard;
+			long long deadline; /**< release time in nanoseconds */
+		};
+
+		int fd_; /**< udev monitor file descriptor */
+		int sigfd_; /**< signalfd for stop signals */
+		int timerfd_; /**< expires grace periods of unplugged keyboards */
+		std::map<std::string, std::unique_ptr<Keyboard>> connected_; /**< keyed by USB device sysfs path */
+		std::map<std::string, Candidate> pending_; /**< keyed by USB device sysfs path */
+		std::map<std::string, Detached> detached_; /**< keyed by getKey() */
+		Reactor reactor_;
+		BlinkService blinkService_; /**< shared by all devices */
+		ControlServer control_;
 		struct udev *udev_;
 		struct udev_monitor *monitor_;
-		libconfig::Config *config_;
+		SettingsStore *settingsStore_;
 		Process *process_;
-		void discover();
-		int probe(struct Device *device, struct sidewinderd::DevNode *devNode);
-		void unbind(std::string product);
+		void bind();
+		void receive();
+		void handleSignals();
+		int reattach(Keyboard *keyboard, sidewinderd::DevNode *devNode);
+		static std::string getWorkdir(const struct Device &device, const sidewinderd::DevNode &devNode, bool isAlone);
+		std::size_t countDevices(const struct Device &device, const std::vector<Candidate> &ready);
+		void expire();
+		void arm();
+		static std::string getKey(const struct Device &device, const sidewinderd::DevNode &devNode);
+		static std::unordered_map<unsigned int, Device> indexDevices();
+		static unsigned int getDeviceId(const char *vendor, const char *product);
+		struct Candidate &addCandidate(struct udev_device *usb, const struct Device *device);
+		int probe(struct udev_device *dev);
+		static bool isChild(const std::string &path, const std::string &parent);
+		void forget(std::string sysPath);
+		void unbind(std::string sysPath);
 };
 
 #endif
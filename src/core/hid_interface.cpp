@@ -5,44 +5,197 @@
  * MIT License. For more information, see LICENSE file.
  */
 
-#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <unistd.h>
 
 #include <linux/hidraw.h>
 
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 
 #include <core/hid_interface.hpp>
+#include <core/logger.hpp>
 
 unsigned char HidInterface::getReport(unsigned char report) {
-	unsigned char buf[2] {};
-	buf[0] = report;
-	int ret = ioctl(*fd_, HIDIOCGFEATURE(sizeof(buf)), buf);
+	struct Command command = Command();
+	struct Read read = Read();
+	command.buf[0] = report;
+	command.size = 2;
+	command.read = &read;
+
+	std::unique_lock<std::mutex> lock(mutex_);
 
-	if (ret < 0) {
-		std::cerr << "Error getting HID feature report." << std::endl;
+	if (isRunning_) {
+		pending_.push_back(command);
+		submitted_.notify_one();
+		completed_.wait(lock, [&read]() { return read.isDone; });
 	} else {
-		std::cout << "getFeatureReport(" << static_cast<int>(report)
-			  << ") returned: " << std::hex
-			  << static_cast<int>(buf[0]) << " "
-			  << static_cast<int>(buf[1]) <<  std::endl;
+		// worker thread is gone, nothing can be queued anymore
+		read.result = ioctl(*fd_, HIDIOCGFEATURE(command.size), command.buf) < 0 ? -errno : 0;
+		read.value = command.buf[1];
 	}
 
-	return buf[1];
+	if (read.result < 0) {
+		LOGGER_ERROR("Error getting HID feature report.");
+	} else {
+		LOGGER_DEBUG("getFeatureReport(%d) returned: %x %x", report, report, read.value);
+	}
+
+	return read.value;
 }
 
-void HidInterface::setReport(unsigned char report, unsigned char value) {
-	unsigned char buf[2];
+void HidInterface::setReport(unsigned char report, unsigned char value, Callback callback) {
 	/* buf[0] is Report ID, buf[1] is value */
-	buf[0] = report;
-	buf[1] = value;
-	/* TODO: check return value */
-	int ret = ioctl(*fd_, HIDIOCSFEATURE(sizeof(buf)), buf);
+	unsigned char buf[2] = {report, value};
+	setFeature(buf, sizeof(buf), callback);
+}
+
+void HidInterface::setFeature(const unsigned char *buf, std::size_t size, Callback callback) {
+	struct Command command = Command();
+	command.size = std::min(size, MAX_FEATURE_REPORT_SIZE);
+	std::memcpy(command.buf, buf, command.size);
+	command.callback = callback;
+	submit(&command);
+}
+
+void HidInterface::start() {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (isRunning_) {
+		return;
+	}
+
+	isRunning_ = true;
+	thread_ = std::thread(&HidInterface::run, this);
+}
+
+void HidInterface::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if (!isRunning_) {
+			return;
+		}
+
+		isRunning_ = false;
+		submitted_.notify_one();
+	}
+
+	thread_.join();
+	done_.clear();
+}
+
+int HidInterface::watch() {
+	return reactor_->add(eventfd_, EPOLLIN, [this](uint32_t) { receive(); });
+}
+
+/*
+ * Queues write. A write to the same report ID, which is still waiting, gets
+ * the new value in place, so it keeps its position relative to writes to
+ * other report IDs.
+ */
+void HidInterface::submit(struct Command *command) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// a queued read has to see the writes before it, so don't look past it
+	for (auto it = pending_.rbegin(); it != pending_.rend() && !it->read; ++it) {
+		if (it->buf[0] == command->buf[0] && it->size == command->size) {
+			*it = *command;
+
+			return;
+		}
+	}
+
+	pending_.push_back(*command);
+	submitted_.notify_one();
+}
+
+/*
+ * Runs on the worker thread, until stop() has been called and all queued
+ * commands have been performed.
+ */
+void HidInterface::run() {
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (true) {
+		submitted_.wait(lock, [this]() { return !pending_.empty() || !isRunning_; });
+
+		if (pending_.empty()) {
+			break;
+		}
 
-	if (ret < 0) {
-		std::cerr << "Error setting HID feature report." << std::endl;
+		std::list<struct Command> current;
+		current.splice(current.begin(), pending_, pending_.begin());
+		auto &command = current.front();
+		lock.unlock();
+
+		int request = command.read ? HIDIOCGFEATURE(command.size) : HIDIOCSFEATURE(command.size);
+		command.result = ioctl(*fd_, request, command.buf) < 0 ? -errno : 0;
+
+		lock.lock();
+
+		if (command.read) {
+			command.read->result = command.result;
+			command.read->value = command.buf[1];
+			command.read->isDone = true;
+			completed_.notify_all();
+			continue;
+		}
+
+		// only the first completion of a batch needs to wake up the event loop
+		if (done_.empty()) {
+			uint64_t value = 1;
+			write(eventfd_, &value, sizeof(value));
+		}
+
+		done_.splice(done_.end(), current);
 	}
 }
 
-HidInterface::HidInterface(int *fd) {
+/*
+ * Runs on the event loop. Delivers results of completed writes in order.
+ */
+void HidInterface::receive() {
+	uint64_t value;
+	read(eventfd_, &value, sizeof(value));
+	std::list<struct Command> done;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		done.swap(done_);
+	}
+
+	for (auto &command : done) {
+		if (command.result < 0) {
+			LOGGER_ERROR("Error setting HID feature report.");
+		}
+
+		if (command.callback) {
+			command.callback(command.result);
+		}
+	}
+}
+
+HidInterface::HidInterface(int *fd, Reactor *reactor) {
 	fd_ = fd;
+	reactor_ = reactor;
+	eventfd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	isRunning_ = false;
+
+	if (eventfd_ < 0) {
+		LOGGER_ERROR("Can't create HID command queue.");
+	}
+
+	start();
+}
+
+HidInterface::~HidInterface() {
+	stop();
+	reactor_->remove(eventfd_);
+	close(eventfd_);
 }
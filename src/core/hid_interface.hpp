@@ -8,16 +8,108 @@
 #ifndef HID_INTERFACE_CLASS_H
 #define HID_INTERFACE_CLASS_H
 
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
 #include <string>
+#include <thread>
 
+#include <core/reactor.hpp>
+
+/* constants */
+const std::size_t MAX_FEATURE_REPORT_SIZE = 64;
+
+/**
+ * Class sending HID feature reports to a device.
+ *
+ * Feature reports are USB control transfers, which can take milliseconds.
+ * Writes are queued and performed in order by a worker thread, so reading
+ * the next input report never waits for them. A queued write replaces the
+ * value of an earlier write to the same report ID, which hasn't been started
+ * yet. Results are delivered on the event loop, once watch() has been called.
+ */
 class HidInterface {
 	public:
+		typedef std::function<void(int result)> Callback;
+
+		/**
+		 * Reads feature report. Waits for all queued writes, so the
+		 * returned value is current. Blocks the calling thread, LedGroup
+		 * only calls it once per report ID, while the keyboard is created.
+		 * @param report report ID
+		 */
 		unsigned char getReport(unsigned char report);
-		void setReport(unsigned char report, unsigned char value);
-		HidInterface(int *fd);
+
+		/**
+		 * Queues write of a single byte feature report.
+		 * @param report report ID
+		 * @param value report value
+		 * @param callback called on the event loop with 0 on success or
+		 * a negative errno, not called if the write has been replaced
+		 */
+		void setReport(unsigned char report, unsigned char value, Callback callback = nullptr);
+
+		/**
+		 * Queues write of a feature report.
+		 * @param buf report, buf[0] is the report ID
+		 * @param size size of report, up to MAX_FEATURE_REPORT_SIZE
+		 * @param callback see setReport()
+		 */
+		void setFeature(const unsigned char *buf, std::size_t size, Callback callback = nullptr);
+
+		/**
+		 * Starts worker thread, e.g. after the device has been reopened.
+		 * Writes queued meanwhile are performed first.
+		 */
+		void start();
+
+		/**
+		 * Performs all queued writes and stops worker thread. Must be
+		 * called before the file descriptor is closed. Pending results
+		 * are discarded.
+		 */
+		void stop();
+
+		/**
+		 * Delivers results on the event loop from now on. The constructor
+		 * doesn't touch the event loop, so devices can be set up on any
+		 * thread.
+		 * @return 0 on success, -1 on error
+		 */
+		int watch();
+		HidInterface(int *fd, Reactor *reactor);
+		~HidInterface();
 
 	private:
+		struct Read {
+			unsigned char value;
+			int result;
+			bool isDone;
+		};
+
+		struct Command {
+			unsigned char buf[MAX_FEATURE_REPORT_SIZE];
+			std::size_t size;
+			struct Read *read; /**< waiting reader, nullptr for writes */
+			int result;
+			Callback callback;
+		};
+
 		int *fd_;
+		int eventfd_; /**< signals completed writes */
+		Reactor *reactor_;
+		bool isRunning_;
+		std::mutex mutex_; /**< protects queues and isRunning_ */
+		std::condition_variable submitted_;
+		std::condition_variable completed_; /**< signals completed reads */
+		std::list<struct Command> pending_;
+		std::list<struct Command> done_;
+		std::thread thread_;
+		void submit(struct Command *command);
+		void run();
+		void receive();
 };
 
 #endif
@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cmath>
+
+#include "histogram.hpp"
+
+void Histogram::record(long long value) {
+	if (value < 0) {
+		value = 0;
+	}
+
+	counts_[getIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	auto max = max_.load(std::memory_order_relaxed);
+
+	while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed));
+}
+
+long long Histogram::getPercentile(double percentile) const {
+	auto count = getCount();
+
+	if (!count) {
+		return 0;
+	}
+
+	auto target = static_cast<unsigned long long>(std::ceil(count * percentile / 100));
+	target = target ? target : 1;
+	unsigned long long sum = 0;
+
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		sum += counts_[i].load(std::memory_order_relaxed);
+
+		if (sum >= target) {
+			auto value = getValue(i);
+			auto max = getMax();
+
+			return value < max ? value : max;
+		}
+	}
+
+	return getMax();
+}
+
+long long Histogram::getMax() const {
+	return max_.load(std::memory_order_relaxed);
+}
+
+unsigned long long Histogram::getCount() const {
+	return count_.load(std::memory_order_relaxed);
+}
+
+/*
+ * Values below 16 get a bucket each. Above, the most significant bit selects
+ * the power of two and the following 4 bits select the sub-bucket.
+ */
+int Histogram::getIndex(unsigned long long value) {
+	if (value < HISTOGRAM_SUB_BUCKETS) {
+		return value;
+	}
+
+	int exponent = 63 - __builtin_clzll(value);
+	int shift = exponent - HISTOGRAM_SUB_BITS;
+
+	return (shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+long long Histogram::getValue(int index) {
+	if (index < HISTOGRAM_SUB_BUCKETS) {
+		return index;
+	}
+
+	int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+	unsigned long long lowest = static_cast<unsigned long long>(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+
+	return lowest + (1ULL << shift) - 1;
+}
+
+Histogram::Histogram() {
+	for (auto &count : counts_) {
+		count = 0;
+	}
+
+	count_ = 0;
+	max_ = 0;
+}
@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef HISTOGRAM_CLASS_H
+#define HISTOGRAM_CLASS_H
+
+#include <atomic>
+
+/* constants */
+const int HISTOGRAM_SUB_BITS = 4;
+const int HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+const int HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+/**
+ * Class counting values in logarithmic buckets, similar to HdrHistogram.
+ *
+ * Every power of two is split into 16 linear sub-buckets, so percentiles are
+ * accurate within about 6 percent over the whole range of 64-bit values.
+ * Recording is lock-free and doesn't allocate, so it can be used on hot paths
+ * of any thread.
+ */
+class Histogram {
+	public:
+		/**
+		 * Counts a value. Negative values are counted as 0.
+		 */
+		void record(long long value);
+
+		/**
+		 * Returns upper bound of the bucket containing the percentile.
+		 * @param percentile percentile between 0 and 100
+		 */
+		long long getPercentile(double percentile) const;
+		long long getMax() const;
+		unsigned long long getCount() const;
+		Histogram();
+
+	private:
+		std::atomic<unsigned long long> counts_[HISTOGRAM_BUCKETS];
+		std::atomic<unsigned long long> count_;
+		std::atomic<long long> max_;
+		static int getIndex(unsigned long long value);
+		static long long getValue(int index);
+};
+
+#endif
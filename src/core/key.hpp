@@ -8,15 +8,18 @@
 #ifndef KEY_CLASS_H
 #define KEY_CLASS_H
 
+#include <cstdint>
 #include <string>
 
 /**
  * Struct for storing and passing key data.
  *
  * @var index key index
+ * @var isPressed true for key presses, false for key releases
  */
 struct KeyData {
 	int index;
+	bool isPressed;
 
 	/**
 	 * Enum class to classify key type.
@@ -33,6 +36,19 @@ struct KeyData {
 	} type;
 };
 
+/**
+ * Struct storing the keys held down in the last report, so press and release
+ * edges can be detected. Bit n represents key index n + 1.
+ *
+ * @var macroKeys bitmap of macro keys
+ * @var extraKeys bitmap of extra keys, or last extra key code for devices
+ * reporting a single extra key at a time
+ */
+struct KeyState {
+	uint32_t macroKeys;
+	uint32_t extraKeys;
+};
+
 /**
  * Class representing a key.
  *
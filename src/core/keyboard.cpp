@@ -7,243 +7,456 @@
 
 #include <cstdio>
 #include <ctime>
-#include <iostream>
 #include <sstream>
-#include <thread>
 
 #include <fcntl.h>
-#include <tinyxml2.h>
 #include <unistd.h>
 
 #include <linux/hidraw.h>
 #include <linux/input.h>
 
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 
-#include "keyboard.hpp"
+#include <core/logger.hpp>
 
-constexpr auto TIMEOUT =	5000;
+#include "keyboard.hpp"
 
 bool Keyboard::isConnected() {
 	return isConnected_;
 }
 
+struct Device Keyboard::getDevice() {
+	return device_;
+}
+
+sidewinderd::DevNode Keyboard::getDevNode() {
+	return devNode_;
+}
+
+LatencyStats *Keyboard::getStats() {
+	return &stats_;
+}
+
+/*
+ * Assembles path to Macro file within this keyboard's profile directory.
+ */
+std::string Keyboard::getMacroPath(struct KeyData *keyData) {
+	Key key(keyData);
+
+	return devNode_.workdir + key.getMacroPath(profile_);
+}
+
+int Keyboard::getProfile() {
+	return profile_;
+}
+
+void Keyboard::setProfile(int profile) {
+	profile_ = profile;
+	loadProfile();
+}
+
+int Keyboard::playMacro(int profile, int index) {
+	struct KeyData keyData = KeyData{index, true, KeyData::KeyType::Macro};
+	Key key(&keyData);
+	auto macro = macroCache_.get(devNode_.workdir + key.getMacroPath(profile));
+
+	if (!macro) {
+		return -1;
+	}
+
+	macroEngine_->play(macro, MacroScheduler::now());
+
+	return 0;
+}
+
+int Keyboard::toggleRecordMode() {
+	return -1;
+}
+
+/*
+ * Compiles all macros of the active profile on the loader thread and pins them
+ * in the cache, so switching profiles doesn't delay the next key press.
+ */
+void Keyboard::loadProfile() {
+	std::stringstream profilePath;
+	profilePath << devNode_.workdir << "profile_" << profile_ + 1 << "/";
+	isFirstPress_ = true;
+	macroLoader_.load(profilePath.str());
+}
+
+/*
+ * Plays macro of the pressed key. Time spent looking up the first macro after
+ * a profile switch is logged, as it shows whether preloading kept up.
+ */
+void Keyboard::playMacro(struct KeyData *keyData) {
+	auto start = MacroScheduler::now();
+	stats_.record(LatencyStats::Stage::Dispatch, start - decoded_);
+	auto macro = macroCache_.get(getMacroPath(keyData));
+	auto loaded = MacroScheduler::now();
+	stats_.record(LatencyStats::Stage::Load, loaded - start);
+
+	if (isFirstPress_) {
+		isFirstPress_ = false;
+		LOGGER_INFO("First macro after profile switch loaded in %lld us", (loaded - start) / 1000);
+	}
+
+	macroEngine_->play(macro, wakeup_);
+}
+
 void Keyboard::connect() {
+	hid_.watch();
+	macroEngine_->watch();
 	isConnected_ = true;
-	listenThread_ = std::thread(&Keyboard::listen, this);
+	keyState_ = KeyState();
+	loadProfile();
+	reactor_->add(fd_, EPOLLIN, [this](uint32_t events) { listen(events); });
 }
 
 void Keyboard::disconnect() {
+	if (recordMode_ == RecordMode::Recording) {
+		stopRecording();
+	}
+
+	// record LED would otherwise keep blinking or be restored on reattach
+	if (recordMode_ != RecordMode::Idle && ledRecord_) {
+		ledRecord_->off();
+	}
+
+	recordMode_ = RecordMode::Idle;
+	reactor_->remove(fd_);
 	isConnected_ = false;
 }
 
-void Keyboard::setupPoll() {
-	fds[0].fd = fd_;
-	fds[0].events = POLLIN;
-	/* ignore second fd for now */
-	fds[1].fd = -1;
-	fds[1].events = POLLIN;
+void Keyboard::detach() {
+	if (isConnected_) {
+		disconnect();
+	}
+
+	// writes queued from now on are performed after reattaching
+	hid_.stop();
+
+	if (fd_ >= 0) {
+		close(fd_);
+		fd_ = -1;
+	}
 }
 
-/* TODO: interrupt and exit play_macro when any macro_key has been pressed */
-void Keyboard::playMacro(std::string macroPath, VirtualInput *virtInput) {
-	tinyxml2::XMLDocument xmlDoc;
-	xmlDoc.LoadFile(macroPath.c_str());
+int Keyboard::reattach(sidewinderd::DevNode *devNode) {
+	detach();
+	devNode_.hidraw = devNode->hidraw;
+	devNode_.inputEvent = devNode->inputEvent;
+	devNode_.sysPath = devNode->sysPath;
+	devNode_.hidrawFd = devNode->hidrawFd;
 
-	if(!xmlDoc.ErrorID()) {
-		tinyxml2::XMLElement* root = xmlDoc.FirstChildElement("Macro");
+	if (openInterface()) {
+		return -1;
+	}
 
-		for (tinyxml2::XMLElement* child = root->FirstChildElement(); child; child = child->NextSiblingElement()) {
-			if (child->Name() == std::string("KeyBoardEvent")) {
-				bool isPressed;
-				int key = std::atoi(child->GetText());
-				child->QueryBoolAttribute("Down", &isPressed);
-				virtInput->sendEvent(EV_KEY, key, isPressed);
-			} else if (child->Name() == std::string("DelayEvent")) {
-				int delay = std::atoi(child->GetText());
-				struct timespec request, remain;
-				/*
-				 * value is given in milliseconds, so we need to split it into
-				 * seconds and nanoseconds. nanosleep() is interruptable and saves
-				 * the remaining sleep time.
-				 */
-				request.tv_sec = delay / 1000;
-				delay = delay - (request.tv_sec * 1000);
-				request.tv_nsec = 1000000L * delay;
-				nanosleep(&request, &remain);
-			}
-		}
+	hid_.start();
+	restore();
+	isConnected_ = true;
+	keyState_ = KeyState();
+	reactor_->add(fd_, EPOLLIN, [this](uint32_t events) { listen(events); });
+
+	return 0;
+}
+
+void Keyboard::restore() {
+}
+
+/*
+ * Opens hidraw interface, unless an opened file descriptor has been injected.
+ */
+int Keyboard::openInterface() {
+	if (devNode_.hidrawFd >= 0) {
+		// simulated device
+		fd_ = devNode_.hidrawFd;
+	} else {
+		/* open file descriptor with root privileges */
+		process_->privilege();
+		fd_ = open(devNode_.hidraw.c_str(), O_RDWR | O_NONBLOCK);
+		process_->unprivilege();
+	}
+
+	if (fd_ < 0) {
+		LOGGER_ERROR("Can't open hidraw interface");
+
+		return -1;
 	}
+
+	return 0;
 }
 
 /*
  * Macro recording captures delays by default. Use the configuration to disable
  * capturing delays.
  */
-void Keyboard::recordMacro(std::string path, Led *ledRecord, const int keyRecord) {
-	struct timeval prev;
-	struct KeyData keyData;
-	prev.tv_usec = 0;
-	prev.tv_sec = 0;
-	std::cout << "Start Macro Recording on " << devNode_.inputEvent << std::endl;
+int Keyboard::startRecording(std::string path) {
+	LOGGER_INFO("Start Macro Recording on %s", devNode_.inputEvent.c_str());
 	process_->privilege();
 	evfd_ = open(devNode_.inputEvent.c_str(), O_RDONLY | O_NONBLOCK);
 	process_->unprivilege();
 
 	if (evfd_ < 0) {
-		std::cout << "Can't open input event file" << std::endl;
+		LOGGER_ERROR("Can't open input event file");
+
+		return -1;
 	}
 
-	/* additionally monitor /dev/input/event* with poll */
-	fds[1].fd = evfd_;
-	tinyxml2::XMLDocument doc;
-	tinyxml2::XMLNode* root = doc.NewElement("Macro");
-	/* start root element "Macro" */
-	doc.InsertFirstChild(root);
+	/*
+	 * only deliver EV_KEY events, so the buffer isn't filled up with
+	 * EV_MSC and EV_SYN events. Older kernels don't support EVIOCSMASK,
+	 * so other events are filtered out below as well.
+	 */
+	unsigned char types[EV_CNT / 8 + 1] = {};
+	types[EV_KEY / 8] |= 1 << (EV_KEY % 8);
+	struct input_mask mask;
+	mask.type = EV_SYN;
+	mask.codes_size = sizeof(types);
+	mask.codes_ptr = reinterpret_cast<uint64_t>(types);
+	ioctl(evfd_, EVIOCSMASK, &mask);
+
+	recordMode_ = RecordMode::Recording;
+	recordPath_ = path;
+	recording_.clear();
+	recording_.reserve(MAX_RECORD_EVENTS);
+
+	/* additionally monitor /dev/input/event* */
+	reactor_->add(evfd_, EPOLLIN, [this](uint32_t events) { recordEvents(events); });
+
+	return 0;
+}
 
-	bool isRecordMode = true;
+/*
+ * Drains all pending events of /dev/input/event* with as few reads as
+ * possible. Kernel timestamps are used for capturing delays, so the time of
+ * reading doesn't affect timing accuracy.
+ */
+void Keyboard::recordEvents(uint32_t events) {
+	// settings are read once per batch, a reload applies to the next one
+	bool captureDelays = settingsStore_->get()->captureDelays;
+	ssize_t nBytes;
 
-	while (isRecordMode) {
-		keyData = pollDevice(2);
+	while ((nBytes = read(evfd_, recordBuffer_, sizeof(recordBuffer_))) > 0) {
+		auto nEvents = nBytes / sizeof(struct input_event);
 
-		if (keyData.index == keyRecord && keyData.type == KeyData::KeyType::Extra) {
-			ledRecord->off();
-			isRecordMode = false;
-		}
+		for (std::size_t i = 0; i < nEvents; i++) {
+			auto &inev = recordBuffer_[i];
 
-		struct input_event inev;
-		read(evfd_, &inev, sizeof(struct input_event));
-
-		if (inev.type == EV_KEY && inev.value != 2) {
-			/* only capturing delays, if capture_delays is set to true */
-			if (prev.tv_usec && config_->lookup("capture_delays")) {
-				auto diff = (inev.time.tv_usec + 1000000 * inev.time.tv_sec) - (prev.tv_usec + 1000000 * prev.tv_sec);
-				auto delay = diff / 1000;
-				/* start element "DelayEvent" */
-				tinyxml2::XMLElement* DelayEvent = doc.NewElement("DelayEvent");
-				DelayEvent->SetText(static_cast<int>(delay));
-				root->InsertEndChild(DelayEvent);
+			if (inev.type != EV_KEY || inev.value == 2) {
+				continue;
 			}
 
-			/* start element "KeyBoardEvent" */
-			tinyxml2::XMLElement* KeyBoardEvent = doc.NewElement("KeyBoardEvent");
+			struct MacroEvent event = MacroEvent();
+			event.type = EV_KEY;
+			event.code = inev.code;
+			event.value = inev.value;
 
-			if (inev.value) {
-				KeyBoardEvent->SetAttribute("Down", true);
-			} else {
-				KeyBoardEvent->SetAttribute("Down", false);
+			if (recording_.empty()) {
+				recordStart_ = inev.time;
+				recordElapsed_ = 0;
+			} else if (captureDelays) {
+				/*
+				 * only capturing delays, if capture_delays is set to
+				 * true. Delays are derived from the time elapsed since
+				 * the first event, so rounding errors don't add up.
+				 */
+				long long elapsed = (inev.time.tv_sec - recordStart_.tv_sec) * 1000LL
+						+ (inev.time.tv_usec - recordStart_.tv_usec) / 1000;
+				event.delay = elapsed - recordElapsed_;
+				recordElapsed_ = elapsed;
 			}
 
-			KeyBoardEvent->SetText(inev.code);
-			root->InsertEndChild(KeyBoardEvent);
-			prev = inev.time;
+			recording_.push_back(event);
 		}
 	}
 
-	/* write XML document */
-	if (doc.SaveFile(path.c_str())) {
-		std::cout << "Error XML SaveFile" << std::endl;
+	// stop watching the event file, if it has been removed
+	if (events & (EPOLLHUP | EPOLLERR)) {
+		reactor_->remove(evfd_);
 	}
+}
 
-	std::cout << "Exit Macro Recording" << std::endl;
-	/* remove event file from poll fds */
-	fds[1].fd = -1;
+void Keyboard::stopRecording() {
+	reactor_->remove(evfd_);
 	close(evfd_);
-}
+	recordMode_ = RecordMode::Idle;
 
-struct KeyData Keyboard::pollDevice(nfds_t nfds) {
-	/*
-	 * poll() checks the device for any activities and blocks the loop,
-	 * either until an event has occured, or the timeout has been reached.
-	 * This leads to a very efficient polling mechanism.
-	 */
-	poll(fds, nfds, TIMEOUT);
+	if (recording_.saveXml(recordPath_)) {
+		LOGGER_ERROR("Error XML SaveFile");
+	}
 
+	recording_.clear();
+	LOGGER_INFO("Exit Macro Recording");
+}
+
+/*
+ * Called by the event loop, whenever the hidraw device is readable. There is no
+ * timeout, so idle devices don't cause any wakeups.
+ */
+void Keyboard::listen(uint32_t events) {
 	// check, if device has been disconnected
-	if (fds->revents & POLLHUP || fds->revents & POLLERR) {
+	if (events & (EPOLLHUP | EPOLLERR)) {
 		disconnect();
 
-		return KeyData();
+		return;
 	}
 
-	struct KeyData keyData = getInput();
+	wakeup_ = reactor_->getWakeup();
+	auto start = MacroScheduler::now();
+	stats_.record(LatencyStats::Stage::Wakeup, start - wakeup_);
+	auto nKeys = getInput(keyBuffer_);
+	decoded_ = MacroScheduler::now();
+	stats_.record(LatencyStats::Stage::Decode, decoded_ - start);
 
-	return keyData;
+	for (std::size_t i = 0; i < nKeys; i++) {
+		dispatch(&keyBuffer_[i]);
+	}
 }
 
-void Keyboard::listen() {
-	while (process_->isActive() && isConnected()) {
-		struct KeyData keyData = pollDevice(1);
-		handleKey(&keyData);
+/*
+ * Handles a key event depending on record mode.
+ */
+void Keyboard::dispatch(struct KeyData *keyData) {
+	switch (recordMode_) {
+		case RecordMode::Idle:
+			handleKey(keyData);
+			break;
+		case RecordMode::Armed:
+			if (keyData->isPressed) {
+				handleRecordKey(keyData);
+			}
+
+			break;
+		case RecordMode::Recording:
+			if (keyData->isPressed && keyData->index == keyRecord_
+					&& keyData->type == KeyData::KeyType::Extra) {
+				ledRecord_->off();
+				stopRecording();
+			}
+
+			break;
 	}
 }
 
-void Keyboard::handleRecordMode(Led *ledRecord, const int keyRecord) {
-	bool isRecordMode = true;
-	/* record LED solid light */
-	ledRecord->on();
-
-	while (isRecordMode) {
-		struct KeyData keyData = pollDevice(1);
-
-		if (keyData.type == KeyData::KeyType::Unknown
-				|| !keyData.index) {
-			/* skip iteration if event is unknown or index is 0 */
-			continue;
-		} else if (keyData.type == KeyData::KeyType::Macro) {
-			/* record LED should blink */
-			ledRecord->blink();
-			isRecordMode = false;
-			Key key(&keyData);
-			recordMacro(key.getMacroPath(profile_), ledRecord, keyRecord);
-		} else if (keyData.type == KeyData::KeyType::Extra) {
-			/* deactivate Record LED */
-			ledRecord->off();
-			isRecordMode = false;
-
-			if (keyData.index != keyRecord) {
-				handleKey(&keyData);
-			}
+/*
+ * Only bits, which differ between both reports, are visited, so a report
+ * with several simultaneous changes yields one event per changed key.
+ */
+std::size_t Keyboard::getEdges(uint32_t previous, uint32_t current, KeyData::KeyType type, struct KeyData *keys) {
+	std::size_t nKeys = 0;
+
+	for (uint32_t changed = previous ^ current; changed; changed &= changed - 1) {
+		int bit = __builtin_ctz(changed);
+		keys[nKeys].index = bit + 1;
+		keys[nKeys].isPressed = (current >> bit) & 1;
+		keys[nKeys].type = type;
+		nKeys++;
+	}
+
+	return nKeys;
+}
+
+void Keyboard::handleRecordKey(struct KeyData *keyData) {
+	if (keyData->type == KeyData::KeyType::Unknown
+			|| !keyData->index) {
+		/* skip event if it is unknown or index is 0 */
+		return;
+	} else if (keyData->type == KeyData::KeyType::Macro) {
+		if (startRecording(getMacroPath(keyData))) {
+			/* leave record mode, there is nothing to record from */
+			ledRecord_->off();
+			recordMode_ = RecordMode::Idle;
+
+			return;
+		}
+
+		/* record LED should blink */
+		ledRecord_->blink();
+	} else if (keyData->type == KeyData::KeyType::Extra) {
+		/* deactivate Record LED */
+		ledRecord_->off();
+		recordMode_ = RecordMode::Idle;
+
+		if (keyData->index != keyRecord_) {
+			handleKey(keyData);
 		}
 	}
 }
 
+/*
+ * Enters record mode. The following key presses are handled by
+ * handleRecordKey(), until record mode has been left.
+ */
+void Keyboard::handleRecordMode(Led *ledRecord, const int keyRecord) {
+	ledRecord_ = ledRecord;
+	keyRecord_ = keyRecord;
+	recordMode_ = RecordMode::Armed;
+	/* record LED solid light */
+	ledRecord_->on();
+}
+
 Keyboard::Keyboard(struct Device *device,
-		sidewinderd::DevNode *devNode, libconfig::Config *config,
-		Process *process) : hid_{&fd_} {
-	config_ = config;
+		sidewinderd::DevNode *devNode, SettingsStore *settingsStore,
+		Process *process, Reactor *reactor, BlinkService *blinkService) : hid_{&fd_, reactor}, macroCache_{MAX_CACHED_EVENTS}, macroLoader_{&macroCache_} {
+	settingsStore_ = settingsStore;
 	process_ = process;
 	device_ = *device;
 	devNode_ = *devNode;
-	virtInput_ = new VirtualInput(&device_, &devNode_, process_);
+	reactor_ = reactor;
+	blinkService_ = blinkService;
+	auto settings = settingsStore_->get();
+	auto keys = settings->deviceKeys.find(device_.vendor + ":" + device_.product);
+	virtInput_ = new VirtualInput(&device_, &devNode_, process_, keys != settings->deviceKeys.end() ? keys->second : "");
+	macroEngine_ = new MacroEngine(reactor_, virtInput_, &macroCache_, &stats_);
 	profile_ = 0;
-	isConnected_ = true;
-
-	for (int i = MIN_PROFILE; i < MAX_PROFILE; i++) {
-		std::stringstream profileFolderPath;
-		profileFolderPath << "profile_" << i + 1;
-		mkdir(profileFolderPath.str().c_str(), S_IRWXU);
-	}
+	isFirstPress_ = false;
+	wakeup_ = 0;
+	decoded_ = 0;
+	isConnected_ = false;
+	keyState_ = KeyState();
+	recordMode_ = RecordMode::Idle;
+	ledRecord_ = nullptr;
+	keyRecord_ = 0;
+	evfd_ = -1;
+
+	// other devices might be set up in parallel, using root privileges
+	process_->runUnprivileged([this]() {
+		if (!devNode_.workdir.empty()) {
+			mkdir(devNode_.workdir.c_str(), S_IRWXU);
+		}
 
-	/* open file descriptor with root privileges */
-	process_->privilege();
-	fd_ = open(devNode->hidraw.c_str(), O_RDWR | O_NONBLOCK);
-	process_->unprivilege();
+		for (int i = MIN_PROFILE; i < MAX_PROFILE; i++) {
+			std::stringstream profileFolderPath;
+			profileFolderPath << devNode_.workdir << "profile_" << i + 1;
+			mkdir(profileFolderPath.str().c_str(), S_IRWXU);
+		}
+	});
 
 	/* TODO: destruct, if interface can't be accessed */
-	if (fd_ < 0) {
-		std::cout << "Can't open hidraw interface" << std::endl;
-	}
-
-	setupPoll();
+	openInterface();
 
-	std::cerr << "Keyboard Constructor" << std::endl;
+	LOGGER_DEBUG("Keyboard Constructor");
 }
 
 Keyboard::~Keyboard() {
-	std::cerr << "Keyboard Destructor" << std::endl;
+	LOGGER_DEBUG("Keyboard Destructor");
+	// LEDs belong to the driver, which has been destroyed already
+	ledRecord_ = nullptr;
 
+	if (isConnected_) {
+		disconnect();
+	}
+
+	// stop macro playback first, it's still using the virtual input device
+	delete macroEngine_;
 	delete virtInput_;
-	close(fd_);
+	// queued feature reports are written before the device is closed
+	hid_.stop();
+
+	if (fd_ >= 0) {
+		close(fd_);
+	}
 }
@@ -8,53 +8,175 @@
 #ifndef KEYBOARD_CLASS_H
 #define KEYBOARD_CLASS_H
 
+#include <cstdint>
 #include <string>
-#include <thread>
 
-#include <poll.h>
+#include <linux/input.h>
 
-#include <libconfig.h++>
+#include <sys/time.h>
 
 #include <process.hpp>
+#include <settings.hpp>
 #include <device_data.hpp>
+#include <core/blink_service.hpp>
 #include <core/device.hpp>
 #include <core/hid_interface.hpp>
 #include <core/key.hpp>
+#include <core/latency_stats.hpp>
 #include <core/led.hpp>
+#include <core/macro_cache.hpp>
+#include <core/macro_engine.hpp>
+#include <core/macro_loader.hpp>
+#include <core/reactor.hpp>
 #include <core/virtual_input.hpp>
 
 /* constants */
 const int MAX_BUF = 8;
 const int MIN_PROFILE = 0;
 const int MAX_PROFILE = 3;
+const std::size_t MAX_CACHED_EVENTS = 65536;
+const std::size_t MAX_RECORD_EVENTS = 4096;
+const std::size_t RECORD_BUFFER_SIZE = 64;
+const std::size_t MAX_KEY_EVENTS = 64;
 
 class Keyboard {
 	public:
 		bool isConnected();
+		struct Device getDevice();
+		sidewinderd::DevNode getDevNode();
+
+		/**
+		 * Returns latency histograms of this keyboard's input path.
+		 */
+		LatencyStats *getStats();
+
+		/**
+		 * Connects keyboard to the event loop. Construction doesn't touch
+		 * the event loop, so keyboards can be created on other threads,
+		 * while the event loop thread waits for them.
+		 */
 		void connect();
 		void disconnect();
-		void listen();
-		Keyboard(struct Device *device, sidewinderd::DevNode *devNode, libconfig::Config *config, Process *process);
+
+		/**
+		 * Releases the hidraw interface of an unplugged device. The
+		 * virtual input device, profile and cached macros are kept, so
+		 * the device can be reattached.
+		 */
+		void detach();
+
+		/**
+		 * Reopens the hidraw interface of a replugged device, restores
+		 * its state and connects it again.
+		 * @param devNode nodes of the replugged device, the profile
+		 * directory is kept
+		 * @return 0 on success, -1 if hidraw can't be opened
+		 */
+		int reattach(sidewinderd::DevNode *devNode);
+		int getProfile();
+
+		/**
+		 * Switches profile and preloads its macros.
+		 * @param profile profile between MIN_PROFILE and MAX_PROFILE - 1
+		 */
+		virtual void setProfile(int profile);
+
+		/**
+		 * Plays macro of a key, as if it had been pressed in the given
+		 * profile.
+		 * @param profile profile between MIN_PROFILE and MAX_PROFILE - 1
+		 * @param index macro key index, e.g. 1 for S1
+		 * @return 0 on success, -1 if there is no such macro
+		 */
+		int playMacro(int profile, int index);
+
+		/**
+		 * Acts like pressing the record key.
+		 * @return 0 on success, -1 if device has no record key
+		 */
+		virtual int toggleRecordMode();
+
+		/**
+		 * Appends press and release events for all keys, which changed
+		 * their state between two reports. Bit n of a bitmap represents
+		 * key index n + 1.
+		 * @return number of appended key events
+		 */
+		static std::size_t getEdges(uint32_t previous, uint32_t current, KeyData::KeyType type, struct KeyData *keys);
+		Keyboard(struct Device *device, sidewinderd::DevNode *devNode, SettingsStore *settingsStore, Process *process, Reactor *reactor, BlinkService *blinkService);
 		virtual ~Keyboard();
 
 	protected:
+		/**
+		 * Enum class describing the state of macro recording.
+		 *
+		 * @var Idle keys are handled normally
+		 * @var Armed record key has been pressed, waiting for macro key
+		 * @var Recording key events are being recorded
+		 */
+		enum class RecordMode {
+			Idle,
+			Armed,
+			Recording
+		} recordMode_;
+
 		bool isConnected_;
 		int profile_;
 		int fd_, evfd_;
-		std::thread listenThread_;
 		Process *process_;
-		struct pollfd fds[2];
 		struct Device device_;
-		libconfig::Config *config_;
+		SettingsStore *settingsStore_;
 		sidewinderd::DevNode devNode_;
 		HidInterface hid_;
+		MacroCache macroCache_;
+		MacroLoader macroLoader_; /**< preloads macros of the active profile */
+		bool isFirstPress_; /**< no macro has been played since profile switch */
 		VirtualInput *virtInput_;
-		virtual struct KeyData getInput() = 0;
-		void setupPoll();
-		static void playMacro(std::string macroPath, VirtualInput *virtInput);
-		void recordMacro(std::string path, Led *ledRecord, const int keyRecord);
-		struct KeyData pollDevice(nfds_t nfds);
+		Reactor *reactor_;
+		BlinkService *blinkService_;
+		LatencyStats stats_;
+		MacroEngine *macroEngine_;
+		Led *ledRecord_;
+		int keyRecord_;
+		std::string recordPath_;
+		Macro recording_;
+		struct input_event recordBuffer_[RECORD_BUFFER_SIZE]; /**< preallocated read buffer */
+		struct timeval recordStart_; /**< kernel time of first recorded event */
+		long long recordElapsed_; /**< milliseconds since first recorded event */
+		struct KeyState keyState_; /**< keys held down in the last report */
+		long long wakeup_; /**< wakeup time of the report being handled */
+		long long decoded_; /**< time, the report being handled was decoded */
+		struct KeyData keyBuffer_[MAX_KEY_EVENTS]; /**< preallocated key event batch */
+
+		/**
+		 * Reads one report and decodes all keys, which have been pressed
+		 * or released since the last report.
+		 * @param keys buffer for at least MAX_KEY_EVENTS key events
+		 * @return number of key events
+		 */
+		virtual std::size_t getInput(struct KeyData *keys) = 0;
+		std::string getMacroPath(struct KeyData *keyData);
+
+		/**
+		 * Preloads macros of the active profile. Needs to be called,
+		 * whenever profile_ changes.
+		 */
+		void loadProfile();
+		void playMacro(struct KeyData *keyData);
+		void listen(uint32_t events);
+		void dispatch(struct KeyData *keyData);
+		int startRecording(std::string path);
+		void stopRecording();
+		void recordEvents(uint32_t events);
 		virtual void handleKey(struct KeyData *keyData) = 0;
+
+		/**
+		 * Writes state, which the daemon keeps for the device, e.g. LEDs,
+		 * to a reattached device.
+		 */
+		virtual void restore();
+		int openInterface();
+		void handleRecordKey(struct KeyData *keyData);
 		void handleRecordMode(Led *ledRecord, const int keyRecord);
 };
 
@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <iomanip>
+
+#include "latency_stats.hpp"
+
+constexpr auto NSEC_PER_USEC =	1000.0;
+
+static const char *STAGE_NAMES[] = {
+	"wakeup",
+	"decode",
+	"dispatch",
+	"load",
+	"first event",
+	"final event"
+};
+
+static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == static_cast<int>(LatencyStats::Stage::Count),
+		"every stage needs a name");
+
+void LatencyStats::record(Stage stage, long long latency) {
+	histograms_[static_cast<int>(stage)].record(latency);
+}
+
+void LatencyStats::dump(std::ostream *out) {
+	auto flags = out->flags();
+	*out << std::fixed << std::setprecision(1);
+
+	for (int i = 0; i < static_cast<int>(Stage::Count); i++) {
+		auto &histogram = histograms_[i];
+		*out << "  " << std::left << std::setw(12) << STAGE_NAMES[i] << std::right
+		     << " n=" << histogram.getCount()
+		     << " p50=" << histogram.getPercentile(50) / NSEC_PER_USEC << " us"
+		     << " p99=" << histogram.getPercentile(99) / NSEC_PER_USEC << " us"
+		     << " max=" << histogram.getMax() / NSEC_PER_USEC << " us" << std::endl;
+	}
+
+	out->flags(flags);
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef LATENCY_STATS_CLASS_H
+#define LATENCY_STATS_CLASS_H
+
+#include <ostream>
+
+#include <core/histogram.hpp>
+
+/**
+ * Class collecting latency histograms of a device's input path.
+ *
+ * All stages are measured on CLOCK_MONOTONIC in nanoseconds. Recording is
+ * lock-free and neither allocates nor does any I/O.
+ */
+class LatencyStats {
+	public:
+		/**
+		 * Enum class describing stages of the input path.
+		 *
+		 * @var Wakeup epoll wakeup until the report is handled
+		 * @var Decode reading and decoding the report
+		 * @var Dispatch decoded report until the macro is looked up
+		 * @var Load looking up and loading the macro
+		 * @var FirstEvent epoll wakeup until the first event is sent
+		 * @var FinalEvent epoll wakeup until the final event is sent,
+		 * excluding delays of the macro itself
+		 */
+		enum class Stage {
+			Wakeup,
+			Decode,
+			Dispatch,
+			Load,
+			FirstEvent,
+			FinalEvent,
+			Count
+		};
+
+		void record(Stage stage, long long latency);
+
+		/**
+		 * Writes count, p50, p99 and max of every stage.
+		 */
+		void dump(std::ostream *out);
+
+	private:
+		Histogram histograms_[static_cast<int>(Stage::Count)];
+};
+
+#endif
@@ -8,9 +8,12 @@
 #include <iostream>
 #include <core/led.hpp>
 
+/* constants */
+constexpr auto BLINK_PERIOD =	1000;
+
 void Led::on() {
-	auto report = hid_->getReport(report_);
-	auto buf = report;
+	stopBlink();
+	auto buf = group_->getReport(report_);
 
 	if (type_ == LedType::Profile) {
 		// clear out all LEDs, but Indicator LEDs
@@ -19,38 +22,55 @@ void Led::on() {
 
 	buf |= led_;
 
-	// don't call, if there are no changes
-	if (buf != report) {
-		hid_->setReport(report_, buf);
-	}
+	// doesn't write anything, if there are no changes
+	group_->setReport(report_, buf);
+	group_->flush();
 }
 
 void Led::off() {
-	auto buf = hid_->getReport(report_);
-	buf &= ~led_;
-	hid_->setReport(report_, buf);
+	stopBlink();
+	setLit(false);
 }
 
 void Led::blink() {
 	if (blink_) {
-		auto buf = hid_->getReport(report_);
+		auto buf = group_->getReport(report_);
 		buf &= ~led_;
 		buf |= blink_;
-		hid_->setReport(report_, buf);
+		group_->setReport(report_, buf);
+		group_->flush();
+	} else if (group_->getBlinkService()) {
+		group_->getBlinkService()->start(this, onPeriod_, offPeriod_);
 	} else {
-		/*
-		 * TODO Implement non-blocking software emulated blink, using
-		 * std::thread and std::chrono. It should start blinking, when
-		 * Led::blink() has been called and stop, when Led::off() has
-		 * been called. 1 second on, 1 second off sounds like a good
-		 * rhythm. It would be perfect, if one could interrupt the blink
-		 * anytime, even in a this_thread::wait_for().
-		 * Until it's implemented, let's use a solid light.
-		 */
+		// without blink service, let's use a solid light
 		on();
 	}
 }
 
+void Led::setBlinkPeriod(unsigned int onPeriod, unsigned int offPeriod) {
+	onPeriod_ = onPeriod;
+	offPeriod_ = offPeriod;
+}
+
+void Led::setLit(bool isLit) {
+	auto buf = group_->getReport(report_);
+
+	if (isLit) {
+		buf |= led_;
+	} else {
+		buf &= ~led_;
+	}
+
+	group_->setReport(report_, buf);
+	group_->flush();
+}
+
+void Led::stopBlink() {
+	if (!blink_ && group_->getBlinkService()) {
+		group_->getBlinkService()->stop(this);
+	}
+}
+
 void Led::registerBlink(unsigned char led) {
 	blink_ = led;
 }
@@ -71,8 +91,14 @@ Led::Led(unsigned char report, unsigned char led, LedGroup *group) {
 	group_ = group;
 	blink_ = 0;
 	type_ = LedType::Common;
-	hid_ = group_->getHidInterface();
+	onPeriod_ = BLINK_PERIOD;
+	offPeriod_ = BLINK_PERIOD;
+
+	// initial LED state is off, it's written with the next flush
+	auto buf = group_->getReport(report_);
+	group_->setReport(report_, buf & ~led_);
+}
 
-	// initial LED state is off
-	off();
+Led::~Led() {
+	stopBlink();
 }
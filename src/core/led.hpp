@@ -35,6 +35,20 @@ class Led {
 		 */
 		void blink();
 
+		/**
+		 * Sets on and off periods of software emulated blinking.
+		 * @param onPeriod time in milliseconds, the LED is lit
+		 * @param offPeriod time in milliseconds, the LED is dark
+		 */
+		void setBlinkPeriod(unsigned int onPeriod, unsigned int offPeriod);
+
+		/**
+		 * Lights or darkens LED, without changing blinking mode. Used
+		 * for software emulated blinking.
+		 * @param isLit true lights LED, false darkens it
+		 */
+		void setLit(bool isLit);
+
 		/**
 		 * If LED supports blinking via hardware, set report ID and
 		 * value using this function.
@@ -48,6 +62,7 @@ class Led {
 		 */
 		void setLedType(LedType type);
 		Led(unsigned char report, unsigned char led, LedGroup *group);
+		~Led();
 
 	private:
 		unsigned char report_;
@@ -55,7 +70,9 @@ class Led {
 		unsigned char blink_;
 		LedGroup *group_;
 		LedType type_;
-		HidInterface *hid_;
+		unsigned int onPeriod_;
+		unsigned int offPeriod_;
+		void stopBlink();
 };
 
 #endif
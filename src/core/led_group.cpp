@@ -19,7 +19,58 @@ HidInterface *LedGroup::getHidInterface() {
 	return hid_;
 }
 
-LedGroup::LedGroup(HidInterface *hid) {
+unsigned char LedGroup::getReport(unsigned char report) {
+	auto it = reports_.find(report);
+
+	if (it == reports_.end()) {
+		it = reports_.insert(std::make_pair(report, Report{hid_->getReport(report), false})).first;
+	}
+
+	return it->second.value;
+}
+
+void LedGroup::setReport(unsigned char report, unsigned char value) {
+	// make sure, report has been read from the device
+	getReport(report);
+	auto &cached = reports_[report];
+
+	if (cached.value != value) {
+		cached.value = value;
+		cached.isDirty = true;
+	}
+}
+
+void LedGroup::flush() {
+	for (auto &it : reports_) {
+		if (it.second.isDirty) {
+			auto report = it.first;
+			it.second.isDirty = false;
+			hid_->setReport(report, it.second.value, [this, report](int result) {
+				// failed writes are retried with the next flush()
+				auto cached = reports_.find(report);
+
+				if (result < 0 && cached != reports_.end()) {
+					cached->second.isDirty = true;
+				}
+			});
+		}
+	}
+}
+
+void LedGroup::restore() {
+	for (auto &it : reports_) {
+		it.second.isDirty = true;
+	}
+
+	flush();
+}
+
+BlinkService *LedGroup::getBlinkService() {
+	return blinkService_;
+}
+
+LedGroup::LedGroup(HidInterface *hid, BlinkService *blinkService) {
 	hid_ = hid;
+	blinkService_ = blinkService;
 	indicator_ = 0;
 }
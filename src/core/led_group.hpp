@@ -8,18 +8,63 @@
 #ifndef LED_GROUP_CLASS_H
 #define LED_GROUP_CLASS_H
 
+#include <map>
+
+#include <core/blink_service.hpp>
 #include <core/hid_interface.hpp>
 
+/**
+ * Class grouping LEDs of a device.
+ *
+ * Feature reports, which hold LED states, are cached in shadow registers. LED
+ * changes are applied to the cached values and written with flush(), so there
+ * is no need to read reports from the device on every change.
+ */
 class LedGroup {
 	public:
 		unsigned char getIndicatorMask();
 		void setIndicatorMask(unsigned char indicator);
 		HidInterface *getHidInterface();
-		LedGroup(HidInterface *hid);
+		BlinkService *getBlinkService();
+
+		/**
+		 * Returns cached value of a feature report. The report is read
+		 * from the device on first access only.
+		 * @param report report ID
+		 */
+		unsigned char getReport(unsigned char report);
+
+		/**
+		 * Changes cached value of a feature report. Changes are written to
+		 * the device with the next flush().
+		 * @param report report ID
+		 * @param value new report value
+		 */
+		void setReport(unsigned char report, unsigned char value);
+
+		/**
+		 * Queues changed reports for writing, using a single request per
+		 * report ID. Failed writes are retried with the next flush().
+		 */
+		void flush();
+
+		/**
+		 * Writes all cached values, e.g. after the device has been
+		 * replugged and has lost its state.
+		 */
+		void restore();
+		LedGroup(HidInterface *hid, BlinkService *blinkService);
 
 	private:
+		struct Report {
+			unsigned char value;
+			bool isDirty;
+		};
+
 		unsigned char indicator_;
 		HidInterface *hid_;
+		BlinkService *blinkService_;
+		std::map<unsigned char, Report> reports_; /**< shadow registers by report ID */
 };
 
 #endif
@@ -0,0 +1,240 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+
+#include <pthread.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+#include <core/macro_scheduler.hpp>
+
+#include "logger.hpp"
+
+constexpr auto MAX_MESSAGE =	512;
+
+static const char *LEVEL_NAMES[] = {"debug", "info", "warning", "error"};
+static const int LEVEL_PRIORITIES[] = {LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERR};
+
+thread_local Logger::RingOwner Logger::owner_ = {nullptr};
+
+Logger *Logger::get() {
+	// never destroyed, so threads can log until the process exits
+	static Logger *logger = new Logger();
+
+	return logger;
+}
+
+void Logger::setLevel(LogLevel level) {
+	level_.store(level, std::memory_order_relaxed);
+}
+
+int Logger::parseLevel(std::string name, LogLevel *level) {
+	for (int i = 0; i <= static_cast<int>(LogLevel::Error); i++) {
+		if (name == LEVEL_NAMES[i]) {
+			*level = static_cast<LogLevel>(i);
+
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int Logger::openFile(std::string path) {
+	FILE *file = std::fopen(path.c_str(), "ae");
+
+	if (!file) {
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (file_ != stderr) {
+		std::fclose(file_);
+	}
+
+	file_ = file;
+	isSyslog_ = false;
+
+	return 0;
+}
+
+void Logger::openSyslog(std::string ident) {
+	// syslog keeps the pointer, so the identifier must outlive the logger
+	static std::string syslogIdent;
+	std::lock_guard<std::mutex> lock(mutex_);
+	syslogIdent = ident;
+	openlog(syslogIdent.c_str(), LOG_PID, LOG_DAEMON);
+	isSyslog_ = true;
+}
+
+void Logger::start() {
+	if (isRunning_) {
+		return;
+	}
+
+	eventfd_ = eventfd(0, EFD_CLOEXEC);
+
+	if (eventfd_ < 0) {
+		LOGGER_ERROR("Can't create log thread, logging synchronously.");
+
+		return;
+	}
+
+	isPending_ = false;
+	isRunning_.store(true, std::memory_order_release);
+
+	/*
+	 * started before the event loop blocks signals for receiving them
+	 * through a signalfd, so the drain thread mustn't catch any of them
+	 */
+	sigset_t mask, oldMask;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &oldMask);
+	thread_ = std::thread(&Logger::drain, this);
+	pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
+
+	// write pending messages on every way out of main()
+	static bool isRegistered = false;
+
+	if (!isRegistered) {
+		isRegistered = true;
+		std::atexit([]() { Logger::get()->stop(); });
+	}
+}
+
+void Logger::stop() {
+	if (!isRunning_) {
+		return;
+	}
+
+	isRunning_.store(false, std::memory_order_release);
+	wake();
+	thread_.join();
+	close(eventfd_);
+	eventfd_ = -1;
+
+	// messages queued while stopping
+	flush();
+}
+
+Logger::Ring *Logger::addRing() {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// reuse rings of exited threads, so short-lived threads don't add up
+	for (auto &ring : rings_) {
+		if (!ring->isOwned.load(std::memory_order_acquire)) {
+			ring->isOwned.store(true, std::memory_order_relaxed);
+
+			return ring.get();
+		}
+	}
+
+	rings_.push_back(std::unique_ptr<Ring>(new Ring()));
+	rings_.back()->isOwned.store(true, std::memory_order_relaxed);
+
+	return rings_.back().get();
+}
+
+void Logger::wake() {
+	uint64_t value = 1;
+	::write(eventfd_, &value, sizeof(value));
+}
+
+/*
+ * Runs on the drain thread. Sleeps until a message has been queued, so an
+ * idle daemon doesn't cause any wakeups.
+ */
+void Logger::drain() {
+	bool isStopping = false;
+
+	while (!isStopping) {
+		uint64_t value;
+		read(eventfd_, &value, sizeof(value));
+		isStopping = !isRunning_.load(std::memory_order_acquire);
+
+		// reset before draining, so messages queued meanwhile wake us up again
+		isPending_.store(false, std::memory_order_release);
+		flush();
+	}
+}
+
+/*
+ * Writes all queued messages of all threads.
+ */
+void Logger::flush() {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (auto &ring : rings_) {
+		auto tail = ring->tail.load(std::memory_order_relaxed);
+		auto head = ring->head.load(std::memory_order_acquire);
+
+		for (; tail != head; tail++) {
+			write(&ring->records[tail % LOG_RING_SIZE]);
+		}
+
+		ring->tail.store(tail, std::memory_order_release);
+	}
+
+	auto dropped = dropped_.exchange(0, std::memory_order_relaxed);
+
+	if (dropped) {
+		char message[MAX_MESSAGE];
+		std::snprintf(message, sizeof(message), "Dropped %llu log messages.", dropped);
+		struct timespec time;
+		clock_gettime(CLOCK_REALTIME, &time);
+		output(LogLevel::Warning, time, message);
+	}
+
+	std::fflush(file_);
+}
+
+/*
+ * Writes message on the calling thread, while the drain thread isn't running.
+ */
+void Logger::emit(const struct Record *record) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	write(record);
+	std::fflush(file_);
+}
+
+void Logger::write(const struct Record *record) {
+	char message[MAX_MESSAGE];
+	record->formatter(record->format, record->payload, message, sizeof(message));
+	output(record->level, record->time, message);
+}
+
+void Logger::output(LogLevel level, const struct timespec &time, const char *message) {
+	auto index = static_cast<int>(level);
+
+	if (isSyslog_) {
+		syslog(LEVEL_PRIORITIES[index], "%s", message);
+
+		return;
+	}
+
+	struct tm tm;
+	char date[32];
+	localtime_r(&time.tv_sec, &tm);
+	std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+	std::fprintf(file_, "%s.%03ld %s: %s\n", date, static_cast<long>(time.tv_nsec / NSEC_PER_MSEC), LEVEL_NAMES[index], message);
+}
+
+Logger::Logger() {
+	level_ = LogLevel::Info;
+	isRunning_ = false;
+	isPending_ = false;
+	dropped_ = 0;
+	eventfd_ = -1;
+	file_ = stderr;
+	isSyslog_ = false;
+}
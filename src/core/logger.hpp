@@ -0,0 +1,328 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef LOGGER_CLASS_H
+#define LOGGER_CLASS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Log statements below this level are removed at compile time, e.g.
+ * -DLOGGER_MIN_LEVEL=1 removes all debug messages.
+ */
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL 0
+#endif
+
+/*
+ * Logs a printf style message. Arguments are only evaluated, if the level is
+ * enabled. Strings are copied, so temporaries like std::string::c_str() are
+ * safe to pass.
+ */
+#define LOGGER_LOG(level, ...) \
+	do { \
+		if (static_cast<int>(level) >= LOGGER_MIN_LEVEL && Logger::get()->isEnabled(level)) { \
+			if (false) { \
+				Logger::check(__VA_ARGS__); \
+			} \
+			Logger::get()->log(level, __VA_ARGS__); \
+		} \
+	} while (0)
+
+#define LOGGER_DEBUG(...) LOGGER_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOGGER_INFO(...) LOGGER_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOGGER_WARNING(...) LOGGER_LOG(LogLevel::Warning, __VA_ARGS__)
+#define LOGGER_ERROR(...) LOGGER_LOG(LogLevel::Error, __VA_ARGS__)
+
+enum class LogLevel {
+	Debug,
+	Info,
+	Warning,
+	Error
+};
+
+/* constants */
+const std::size_t LOG_PAYLOAD_SIZE = 224; /**< bytes for arguments */
+const std::size_t LOG_RING_SIZE = 256; /**< records per thread */
+
+/**
+ * Class writing log messages on a background thread.
+ *
+ * Every thread gets its own lock-free ring of fixed size records. Logging
+ * copies the format string pointer and the raw arguments into the next
+ * record, formatting and writing happen on the drain thread. If a ring is
+ * full, messages are dropped and counted instead of blocking the caller.
+ * Until start() has been called, messages are written synchronously.
+ */
+class Logger {
+	public:
+		/**
+		 * Returns process wide logger.
+		 */
+		static Logger *get();
+
+		/**
+		 * Checks runtime level. Can be called from any thread.
+		 */
+		bool isEnabled(LogLevel level) const {
+			return level >= level_.load(std::memory_order_relaxed);
+		}
+
+		void setLevel(LogLevel level);
+
+		/**
+		 * Parses level name, e.g. "debug".
+		 * @return 0 on success, -1 if name is unknown
+		 */
+		static int parseLevel(std::string name, LogLevel *level);
+
+		/**
+		 * Appends messages to a file instead of stderr.
+		 * @return 0 on success, -1 on error
+		 */
+		int openFile(std::string path);
+
+		/**
+		 * Sends messages to syslog, which forwards them to the journal
+		 * on systemd based systems.
+		 */
+		void openSyslog(std::string ident);
+
+		/**
+		 * Starts drain thread. Call it after forking, as threads don't
+		 * survive fork(). Pending messages are written at exit.
+		 */
+		void start();
+
+		/**
+		 * Writes all pending messages and stops drain thread.
+		 */
+		void stop();
+
+		/**
+		 * Queues message. Use the LOGGER_* macros instead, they skip
+		 * disabled levels without evaluating any arguments.
+		 */
+		template <typename... Args>
+		void log(LogLevel level, const char *format, Args... args) {
+			static_assert(ScalarSize<Args...>::value <= LOG_PAYLOAD_SIZE, "Too many log arguments");
+
+			if (!isRunning_.load(std::memory_order_acquire)) {
+				struct Record record;
+				fill(&record, level, format, args...);
+				emit(&record);
+
+				return;
+			}
+
+			if (!owner_.ring) {
+				owner_.ring = addRing();
+			}
+
+			auto ring = owner_.ring;
+			auto head = ring->head.load(std::memory_order_relaxed);
+
+			if (head - ring->tail.load(std::memory_order_acquire) == LOG_RING_SIZE) {
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+
+				return;
+			}
+
+			fill(&ring->records[head % LOG_RING_SIZE], level, format, args...);
+			ring->head.store(head + 1, std::memory_order_release);
+
+			// only the first message after the drain thread went idle wakes it up
+			if (!isPending_.exchange(true, std::memory_order_acq_rel)) {
+				wake();
+			}
+		}
+
+		/**
+		 * Never called, lets the compiler check format and arguments.
+		 */
+		__attribute__((format(printf, 1, 2)))
+		static void check(const char *, ...) {}
+
+	private:
+		typedef int (*Formatter)(const char *format, const unsigned char *payload, char *buf, std::size_t size);
+
+		struct Record {
+			struct timespec time;
+			LogLevel level;
+			const char *format; /**< string literal */
+			Formatter formatter; /**< decodes payload for this format */
+			unsigned char payload[LOG_PAYLOAD_SIZE];
+		};
+
+		/**
+		 * Single producer, single consumer ring. head is only written by
+		 * the owning thread, tail only by the drain thread. Rings of exited
+		 * threads are handed to new threads.
+		 */
+		struct Ring {
+			struct Record records[LOG_RING_SIZE];
+			std::atomic<std::size_t> head;
+			std::atomic<std::size_t> tail;
+			std::atomic<bool> isOwned;
+		};
+
+		/*
+		 * releases the ring of a thread, when the thread exits
+		 */
+		struct RingOwner {
+			Ring *ring;
+
+			~RingOwner() {
+				if (ring) {
+					ring->isOwned.store(false, std::memory_order_release);
+				}
+			}
+		};
+
+		/*
+		 * strings are stored inline, everything else is copied as is
+		 */
+		template <typename T>
+		struct Stored {
+			typedef typename std::conditional<std::is_same<T, char *>::value, const char *, T>::type type;
+			static const bool isString = std::is_same<type, const char *>::value;
+		};
+
+		/*
+		 * payload needed by all but strings, which need at least their
+		 * terminator
+		 */
+		template <typename... Args>
+		struct ScalarSize {
+			static const std::size_t value = 0;
+		};
+
+		template <typename T, typename... Rest>
+		struct ScalarSize<T, Rest...> {
+			static const std::size_t value = (Stored<T>::isString ? 1 : sizeof(T)) + ScalarSize<Rest...>::value;
+		};
+
+		template <std::size_t... I>
+		struct Indices {};
+
+		template <std::size_t N, std::size_t... I>
+		struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+		template <std::size_t... I>
+		struct MakeIndices<0, I...> {
+			typedef Indices<I...> type;
+		};
+
+		std::atomic<LogLevel> level_;
+		std::atomic<bool> isRunning_;
+		std::atomic<bool> isPending_; /**< drain thread has been woken up */
+		std::atomic<unsigned long long> dropped_;
+		int eventfd_;
+		std::thread thread_;
+		std::mutex mutex_; /**< protects rings_ and the sink */
+		std::vector<std::unique_ptr<Ring>> rings_;
+		FILE *file_;
+		bool isSyslog_;
+		static thread_local RingOwner owner_;
+		Ring *addRing();
+		void wake();
+		void drain();
+		void flush();
+		void emit(const struct Record *record);
+		void write(const struct Record *record);
+		void output(LogLevel level, const struct timespec &time, const char *message);
+		Logger();
+		Logger(const Logger &) = delete;
+		Logger &operator=(const Logger &) = delete;
+
+		template <typename... Args>
+		static void fill(struct Record *record, LogLevel level, const char *format, Args... args) {
+			clock_gettime(CLOCK_REALTIME, &record->time);
+			record->level = level;
+			record->format = format;
+			record->formatter = &Logger::format<typename Stored<Args>::type...>;
+			encode(record->payload, record->payload + LOG_PAYLOAD_SIZE, args...);
+		}
+
+		static void encode(unsigned char *, unsigned char *) {}
+
+		template <typename T, typename... Rest>
+		static void encode(unsigned char *pos, unsigned char *end, T value, Rest... rest) {
+			// leave enough space for the remaining arguments
+			pos = put(pos, end - ScalarSize<Rest...>::value, static_cast<typename Stored<T>::type>(value));
+			encode(pos, end, rest...);
+		}
+
+		template <typename T>
+		static unsigned char *put(unsigned char *pos, unsigned char *, T value) {
+			static_assert(std::is_arithmetic<T>::value || std::is_pointer<T>::value, "Unsupported log argument");
+			std::memcpy(pos, &value, sizeof(value));
+
+			return pos + sizeof(value);
+		}
+
+		static unsigned char *put(unsigned char *pos, unsigned char *end, const char *value) {
+			// long strings are truncated
+			std::size_t length = value ? strnlen(value, end - pos - 1) : 0;
+			std::memcpy(pos, value, length);
+			pos[length] = '\0';
+
+			return pos + length + 1;
+		}
+
+		template <typename T>
+		static const unsigned char *get(const unsigned char *pos, T *value) {
+			std::memcpy(value, pos, sizeof(*value));
+
+			return pos + sizeof(*value);
+		}
+
+		static const unsigned char *get(const unsigned char *pos, const char **value) {
+			*value = reinterpret_cast<const char *>(pos);
+
+			return pos + std::strlen(*value) + 1;
+		}
+
+		template <std::size_t I, typename Tuple>
+		static typename std::enable_if<I == std::tuple_size<Tuple>::value>::type decode(const unsigned char *, Tuple *) {}
+
+		template <std::size_t I, typename Tuple>
+		static typename std::enable_if<I < std::tuple_size<Tuple>::value>::type decode(const unsigned char *pos, Tuple *args) {
+			decode<I + 1>(get(pos, &std::get<I>(*args)), args);
+		}
+
+		template <typename... Args>
+		static int format(const char *format, const unsigned char *payload, char *buf, std::size_t size) {
+			std::tuple<Args...> args;
+			decode<0>(payload, &args);
+
+			return print(buf, size, format, args, typename MakeIndices<sizeof...(Args)>::type());
+		}
+
+		template <typename Tuple, std::size_t... I>
+		static int print(char *buf, std::size_t size, const char *format, const Tuple &args, Indices<I...>) {
+			return std::snprintf(buf, size, format, std::get<I>(args)...);
+		}
+
+		static int print(char *buf, std::size_t size, const char *format, const std::tuple<> &, Indices<>) {
+			// unused arguments are ignored, but avoid the warning for non-literal formats
+			return std::snprintf(buf, size, format, 0);
+		}
+};
+
+#endif
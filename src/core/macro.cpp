@@ -0,0 +1,404 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <tinyxml2.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "macro.hpp"
+
+constexpr auto MACRO_FILE_MAGIC =	"SWDM";
+constexpr auto MIN_MACRO_FILE_VERSION =	1;
+
+static_assert(sizeof(struct MacroEvent) == 12, "MacroEvent must be packed");
+static_assert(sizeof(struct MacroFileHeader) == 16, "MacroFileHeader must be packed");
+
+/*
+ * Compiles the children of an XML element. A Repeat block becomes a repeat
+ * instruction, its body and an end instruction, which jumps back as long as
+ * iterations are left. Delays before the end of a block are part of every
+ * iteration.
+ */
+static int compile(const tinyxml2::XMLElement *parent, std::vector<struct MacroEvent> *events, uint32_t *delay, std::size_t depth) {
+	for (auto child = parent->FirstChildElement(); child; child = child->NextSiblingElement()) {
+		std::string name = child->Name();
+		unsigned int variable = 0;
+
+		if (name == "Repeat") {
+			int count = 0;
+			child->QueryIntAttribute("Count", &count);
+			auto start = events->size();
+			events->push_back(MacroEvent{MACRO_OP_REPEAT, 0, count, *delay});
+			*delay = 0;
+
+			if (depth + 1 > MAX_MACRO_DEPTH || compile(child, events, delay, depth + 1)) {
+				return -1;
+			}
+
+			auto offset = events->size() - start;
+
+			if (offset > UINT16_MAX) {
+				return -1;
+			}
+
+			(*events)[start].code = offset;
+			events->push_back(MacroEvent{MACRO_OP_END, static_cast<uint16_t>(offset), 0, *delay});
+			*delay = 0;
+
+			continue;
+		}
+
+		auto text = child->GetText();
+
+		if (!text) {
+			continue;
+		}
+
+		if (name == "KeyBoardEvent") {
+			bool isPressed = false;
+			child->QueryBoolAttribute("Down", &isPressed);
+			struct MacroEvent event;
+			event.type = EV_KEY;
+			event.code = std::atoi(text);
+			event.value = isPressed;
+			event.delay = *delay;
+			events->push_back(event);
+			*delay = 0;
+		} else if (name == "DelayEvent" && child->QueryUnsignedAttribute("Variable", &variable) == tinyxml2::XML_SUCCESS) {
+			// scaled delays depend on the variable at runtime
+			if (variable >= MAX_MACRO_VARIABLES) {
+				return -1;
+			}
+
+			events->push_back(MacroEvent{MACRO_OP_DELAY, static_cast<uint16_t>(variable), std::atoi(text), *delay});
+			*delay = 0;
+		} else if (name == "DelayEvent") {
+			auto value = std::atoi(text);
+
+			if (value > 0) {
+				*delay += value;
+			}
+		} else if (name == "Variable") {
+			if (child->QueryUnsignedAttribute("Index", &variable) || variable >= MAX_MACRO_VARIABLES) {
+				return -1;
+			}
+
+			events->push_back(MacroEvent{MACRO_OP_SET, static_cast<uint16_t>(variable), std::atoi(text), *delay});
+			*delay = 0;
+		} else if (name == "Call") {
+			events->push_back(MacroEvent{MACRO_OP_CALL, 0, std::atoi(text), *delay});
+			*delay = 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Checks jumps and variables of binary macro files, so a damaged file can't
+ * make the engine read beyond the macro.
+ */
+static int validate(const struct MacroEvent *events, std::size_t size) {
+	for (std::size_t i = 0; i < size; i++) {
+		auto &event = events[i];
+
+		if (event.type == MACRO_OP_REPEAT && (!event.code || i + event.code >= size
+				|| events[i + event.code].type != MACRO_OP_END
+				|| events[i + event.code].code != event.code)) {
+			return -1;
+		} else if (event.type == MACRO_OP_END && (!event.code || event.code > i
+				|| events[i - event.code].type != MACRO_OP_REPEAT)) {
+			return -1;
+		} else if ((event.type == MACRO_OP_SET || event.type == MACRO_OP_DELAY)
+				&& event.code >= MAX_MACRO_VARIABLES) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+const struct MacroEvent &Macro::operator[](std::size_t index) const {
+	return begin()[index];
+}
+
+const struct MacroEvent *Macro::begin() const {
+	if (map_) {
+		return mapEvents_;
+	}
+
+	return events_.data();
+}
+
+const struct MacroEvent *Macro::end() const {
+	return begin() + size();
+}
+
+std::size_t Macro::size() const {
+	if (map_) {
+		return mapSize_;
+	}
+
+	return events_.size();
+}
+
+bool Macro::empty() const {
+	return !size();
+}
+
+void Macro::push_back(const struct MacroEvent &event) {
+	events_.push_back(event);
+}
+
+void Macro::reserve(std::size_t size) {
+	events_.reserve(size);
+}
+
+void Macro::clear() {
+	unmap();
+	events_.clear();
+}
+
+int Macro::load(std::string path) {
+	path_ = path;
+	struct stat xmlStat, binStat;
+	auto binPath = getBinaryPath(path);
+	bool hasXml = !stat(path.c_str(), &xmlStat);
+	bool hasBin = !stat(binPath.c_str(), &binStat);
+
+	// XML file has been edited after conversion, so it takes precedence
+	if (hasBin && hasXml && (xmlStat.st_mtim.tv_sec > binStat.st_mtim.tv_sec
+			|| (xmlStat.st_mtim.tv_sec == binStat.st_mtim.tv_sec
+			&& xmlStat.st_mtim.tv_nsec > binStat.st_mtim.tv_nsec))) {
+		hasBin = false;
+	}
+
+	if (hasBin && !loadBinary(binPath)) {
+		return 0;
+	}
+
+	if (hasXml) {
+		return loadXml(path);
+	}
+
+	return -1;
+}
+
+int Macro::loadXml(std::string path) {
+	clear();
+	tinyxml2::XMLDocument xmlDoc;
+	xmlDoc.LoadFile(path.c_str());
+
+	if (xmlDoc.ErrorID()) {
+		return -1;
+	}
+
+	tinyxml2::XMLElement* root = xmlDoc.FirstChildElement("Macro");
+
+	if (!root) {
+		return -1;
+	}
+
+	// delays are accumulated and attached to the following instruction
+	uint32_t delay = 0;
+
+	if (compile(root, &events_, &delay, 0)) {
+		events_.clear();
+
+		return -1;
+	}
+
+	if (delay) {
+		// preserve trailing delay with an event, which doesn't emit anything
+		push_back(MacroEvent{EV_SYN, 0, 0, delay});
+	}
+
+	return 0;
+}
+
+int Macro::loadBinary(std::string path) {
+	clear();
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) || st.st_size < static_cast<off_t>(sizeof(struct MacroFileHeader))) {
+		close(fd);
+
+		return -1;
+	}
+
+	void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	auto header = static_cast<const struct MacroFileHeader *>(map);
+	std::size_t available = (st.st_size - sizeof(struct MacroFileHeader)) / sizeof(struct MacroEvent);
+
+	if (std::memcmp(header->magic, MACRO_FILE_MAGIC, sizeof(header->magic))
+			|| header->version < MIN_MACRO_FILE_VERSION
+			|| header->version > MACRO_FILE_VERSION
+			|| header->recordSize != sizeof(struct MacroEvent)
+			|| header->count > available
+			|| validate(reinterpret_cast<const struct MacroEvent *>(header + 1), header->count)) {
+		munmap(map, st.st_size);
+
+		return -1;
+	}
+
+	map_ = map;
+	mapLength_ = st.st_size;
+	mapEvents_ = reinterpret_cast<const struct MacroEvent *>(header + 1);
+	mapSize_ = header->count;
+
+	return 0;
+}
+
+int Macro::saveXml(std::string path) const {
+	tinyxml2::XMLDocument doc;
+	tinyxml2::XMLNode* root = doc.NewElement("Macro");
+	/* start root element "Macro" */
+	doc.InsertFirstChild(root);
+
+	// innermost Repeat block last
+	std::vector<tinyxml2::XMLNode*> parents = {root};
+
+	for (auto &event : *this) {
+		auto parent = parents.back();
+
+		if (event.delay) {
+			/* start element "DelayEvent" */
+			tinyxml2::XMLElement* DelayEvent = doc.NewElement("DelayEvent");
+			DelayEvent->SetText(static_cast<int>(event.delay));
+			parent->InsertEndChild(DelayEvent);
+		}
+
+		if (event.type == EV_KEY) {
+			/* start element "KeyBoardEvent" */
+			tinyxml2::XMLElement* KeyBoardEvent = doc.NewElement("KeyBoardEvent");
+
+			if (event.value) {
+				KeyBoardEvent->SetAttribute("Down", true);
+			} else {
+				KeyBoardEvent->SetAttribute("Down", false);
+			}
+
+			KeyBoardEvent->SetText(event.code);
+			parent->InsertEndChild(KeyBoardEvent);
+		} else if (event.type == MACRO_OP_REPEAT) {
+			/* start element "Repeat" */
+			tinyxml2::XMLElement* Repeat = doc.NewElement("Repeat");
+			Repeat->SetAttribute("Count", event.value);
+			parent->InsertEndChild(Repeat);
+			parents.push_back(Repeat);
+		} else if (event.type == MACRO_OP_END && parents.size() > 1) {
+			parents.pop_back();
+		} else if (event.type == MACRO_OP_CALL) {
+			/* start element "Call" */
+			tinyxml2::XMLElement* Call = doc.NewElement("Call");
+			Call->SetText(event.value);
+			parent->InsertEndChild(Call);
+		} else if (event.type == MACRO_OP_SET) {
+			/* start element "Variable" */
+			tinyxml2::XMLElement* Variable = doc.NewElement("Variable");
+			Variable->SetAttribute("Index", event.code);
+			Variable->SetText(event.value);
+			parent->InsertEndChild(Variable);
+		} else if (event.type == MACRO_OP_DELAY) {
+			/* start element "DelayEvent" */
+			tinyxml2::XMLElement* DelayEvent = doc.NewElement("DelayEvent");
+			DelayEvent->SetAttribute("Variable", event.code);
+			DelayEvent->SetText(event.value);
+			parent->InsertEndChild(DelayEvent);
+		}
+	}
+
+	/* write XML document */
+	if (doc.SaveFile(path.c_str())) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int Macro::saveBinary(std::string path) const {
+	auto tmpPath = path + ".tmp";
+	int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct MacroFileHeader header = MacroFileHeader();
+	std::memcpy(header.magic, MACRO_FILE_MAGIC, sizeof(header.magic));
+	header.version = MACRO_FILE_VERSION;
+	header.recordSize = sizeof(struct MacroEvent);
+	header.count = size();
+
+	ssize_t length = size() * sizeof(struct MacroEvent);
+	bool isWritten = write(fd, &header, sizeof(header)) == sizeof(header)
+			&& write(fd, begin(), length) == length;
+
+	if (close(fd) || !isWritten || rename(tmpPath.c_str(), path.c_str())) {
+		unlink(tmpPath.c_str());
+
+		return -1;
+	}
+
+	return 0;
+}
+
+std::string Macro::getBinaryPath(std::string path) {
+	auto pos = path.rfind(".xml");
+
+	if (pos != std::string::npos && pos + 4 == path.size()) {
+		path.erase(pos);
+	}
+
+	return path + ".bin";
+}
+
+std::string Macro::getPath() const {
+	return path_;
+}
+
+void Macro::unmap() {
+	if (map_) {
+		munmap(map_, mapLength_);
+		map_ = nullptr;
+		mapLength_ = 0;
+		mapEvents_ = nullptr;
+		mapSize_ = 0;
+	}
+}
+
+Macro::Macro() {
+	map_ = nullptr;
+	mapLength_ = 0;
+	mapEvents_ = nullptr;
+	mapSize_ = 0;
+}
+
+Macro::~Macro() {
+	unmap();
+}
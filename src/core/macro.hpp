@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef MACRO_CLASS_H
+#define MACRO_CLASS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* constants */
+const uint16_t MACRO_FILE_VERSION = 2;
+const std::size_t MAX_MACRO_DEPTH = 8; /**< nested repeats and calls */
+const std::size_t MAX_MACRO_VARIABLES = 8;
+const int32_t MACRO_VARIABLE_DEFAULT = 100; /**< delay scale in percent */
+
+/*
+ * instructions beyond input event types, which never exceed EV_MAX
+ */
+const uint16_t MACRO_OP_REPEAT = 0x100; /**< value: count, code: offset to end */
+const uint16_t MACRO_OP_END = 0x101; /**< code: offset back to repeat */
+const uint16_t MACRO_OP_CALL = 0x102; /**< value: key of macro in same directory */
+const uint16_t MACRO_OP_SET = 0x103; /**< code: variable, value: new value */
+const uint16_t MACRO_OP_DELAY = 0x104; /**< code: variable, value: delay scaled by variable in percent */
+
+/**
+ * Struct for storing a single compiled macro instruction.
+ *
+ * Most instructions are input events. Events with type EV_SYN don't emit
+ * anything, they are used to preserve trailing delays at the end of a macro.
+ * Types starting at MACRO_OP_REPEAT control the flow of the macro instead. The
+ * struct is also the on-disk record of binary macro files, so its layout must
+ * not change without bumping MACRO_FILE_VERSION.
+ *
+ * @var type type of input event, e.g. EV_KEY, or instruction
+ * @var code keycode defined in header file input.h
+ * @var value value the event carries, e.g. EV_KEY: 0 represents release, 1
+ * keypress
+ * @var delay delay in milliseconds, which needs to pass before this
+ * instruction is executed
+ */
+struct MacroEvent {
+	uint16_t type;
+	uint16_t code;
+	int32_t value;
+	uint32_t delay;
+};
+
+/**
+ * Header of binary macro files. It's followed by count packed MacroEvent
+ * records in host byte order.
+ */
+struct MacroFileHeader {
+	char magic[4]; /**< "SWDM" */
+	uint16_t version;
+	uint16_t recordSize; /**< sizeof(struct MacroEvent) */
+	uint32_t count; /**< number of records */
+	uint32_t reserved;
+};
+
+/**
+ * Class representing a compiled macro, which is a flat list of macro
+ * instructions.
+ *
+ * Repeat blocks are compiled to jumps, so a loop takes two instructions,
+ * regardless of its count. Instructions are either stored in memory or, for
+ * binary macro files, mapped read-only from disk without any parsing.
+ */
+class Macro {
+	public:
+		const struct MacroEvent &operator[](std::size_t index) const;
+		const struct MacroEvent *begin() const;
+		const struct MacroEvent *end() const;
+		std::size_t size() const;
+		bool empty() const;
+		void push_back(const struct MacroEvent &event);
+		void reserve(std::size_t size);
+		void clear();
+
+		/**
+		 * Loads a macro, preferring the binary file over the XML file,
+		 * unless the XML file is newer.
+		 * @param path path to XML macro file
+		 * @return 0 on success, -1 on error
+		 */
+		int load(std::string path);
+		int loadXml(std::string path);
+		int loadBinary(std::string path);
+		int saveXml(std::string path) const;
+
+		/**
+		 * Writes binary macro file. The file is replaced atomically, so
+		 * running playbacks keep their mapping intact.
+		 */
+		int saveBinary(std::string path) const;
+
+		/**
+		 * Assembles path to binary file from path to XML file.
+		 */
+		static std::string getBinaryPath(std::string path);
+
+		/**
+		 * Returns path passed to load(), called macros are looked up
+		 * relative to it.
+		 */
+		std::string getPath() const;
+		Macro();
+		~Macro();
+
+	private:
+		std::vector<struct MacroEvent> events_;
+		void *map_; /**< mapped binary file, nullptr if not mapped */
+		std::size_t mapLength_;
+		const struct MacroEvent *mapEvents_;
+		std::size_t mapSize_;
+		std::string path_;
+		void unmap();
+		Macro(const Macro &) = delete;
+		Macro &operator=(const Macro &) = delete;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <sys/stat.h>
+
+#include "macro_cache.hpp"
+
+std::shared_ptr<const Macro> MacroCache::get(std::string macroPath) {
+	auto xml = getStamp(macroPath);
+	auto bin = getStamp(Macro::getBinaryPath(macroPath));
+
+	if (!xml.exists && !bin.exists) {
+		// file has been removed or has never existed
+		std::lock_guard<std::mutex> lock(mutex_);
+		erase(macroPath);
+
+		return nullptr;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = index_.find(macroPath);
+
+		if (it != index_.end()) {
+			auto entry = it->second;
+
+			if (isEqual(entry->xml, xml) && isEqual(entry->bin, bin)) {
+				// cache hit, mark entry as most recently used
+				entries_.splice(entries_.begin(), entries_, entry);
+
+				return entry->macro;
+			}
+
+			// file has been modified since it was cached
+			erase(macroPath);
+		}
+	}
+
+	// load outside of lock, so other lookups don't have to wait
+	auto macro = std::make_shared<Macro>();
+
+	if (macro->load(macroPath)) {
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	// don't cache macros, which exceed the whole capacity
+	if (macro->size() <= capacity_) {
+		erase(macroPath);
+		entries_.push_front(Entry{macroPath, macro, xml, bin, pinned_.count(macroPath) > 0});
+		index_[macroPath] = entries_.begin();
+		size_ += macro->size();
+		evict();
+	}
+
+	return macro;
+}
+
+void MacroCache::pin(const std::vector<std::string> &macroPaths) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	pinned_ = std::unordered_set<std::string>(macroPaths.begin(), macroPaths.end());
+
+	for (auto &entry : entries_) {
+		entry.isPinned = pinned_.count(entry.path) > 0;
+	}
+
+	// previously pinned macros might exceed the capacity now
+	evict();
+}
+
+void MacroCache::clear() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.clear();
+	index_.clear();
+	size_ = 0;
+}
+
+struct MacroCache::Stamp MacroCache::getStamp(std::string path) {
+	struct Stamp stamp = Stamp();
+	struct stat st;
+
+	if (!stat(path.c_str(), &st)) {
+		stamp.mtime = st.st_mtim;
+		stamp.size = st.st_size;
+		stamp.exists = true;
+	}
+
+	return stamp;
+}
+
+bool MacroCache::isEqual(const struct Stamp &a, const struct Stamp &b) {
+	return a.exists == b.exists
+		&& a.mtime.tv_sec == b.mtime.tv_sec
+		&& a.mtime.tv_nsec == b.mtime.tv_nsec
+		&& a.size == b.size;
+}
+
+void MacroCache::erase(std::string macroPath) {
+	auto it = index_.find(macroPath);
+
+	if (it != index_.end()) {
+		size_ -= it->second->macro->size();
+		entries_.erase(it->second);
+		index_.erase(it);
+	}
+}
+
+void MacroCache::evict() {
+	// remove least recently used entries, until we're within bounds
+	for (auto it = entries_.end(); size_ > capacity_ && it != entries_.begin();) {
+		--it;
+
+		if (!it->isPinned) {
+			size_ -= it->macro->size();
+			index_.erase(it->path);
+			it = entries_.erase(it);
+		}
+	}
+}
+
+MacroCache::MacroCache(std::size_t capacity) {
+	capacity_ = capacity;
+	size_ = 0;
+}
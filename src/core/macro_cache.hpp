@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef MACRO_CACHE_CLASS_H
+#define MACRO_CACHE_CLASS_H
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <core/macro.hpp>
+
+/**
+ * Class caching compiled macros in memory.
+ *
+ * Macro files are parsed only once and served from memory afterwards. The
+ * cache is bounded by the total number of cached events and evicts the least
+ * recently used macros first. Modified macro files are detected by comparing
+ * modification time and size of both XML and binary macro files. Pinned
+ * macros, e.g. those of the active profile, are exempt from eviction.
+ */
+class MacroCache {
+	public:
+		/**
+		 * Returns compiled macro, loading it from disk if needed.
+		 * @param macroPath path to macro file
+		 * @return compiled macro or nullptr, if file can't be loaded
+		 */
+		std::shared_ptr<const Macro> get(std::string macroPath);
+
+		/**
+		 * Pins macros, so they are never evicted. Replaces previously
+		 * pinned macros, which become regular entries again.
+		 * @param macroPaths paths to macro files
+		 */
+		void pin(const std::vector<std::string> &macroPaths);
+
+		/**
+		 * Removes all cached macros.
+		 */
+		void clear();
+		MacroCache(std::size_t capacity);
+
+	private:
+		/**
+		 * Struct identifying the state of a file on disk.
+		 */
+		struct Stamp {
+			struct timespec mtime;
+			off_t size;
+			bool exists;
+		};
+
+		struct Entry {
+			std::string path;
+			std::shared_ptr<const Macro> macro;
+			struct Stamp xml;
+			struct Stamp bin;
+			bool isPinned;
+		};
+
+		std::size_t capacity_; /**< maximum number of cached events */
+		std::size_t size_; /**< current number of cached events */
+		std::list<Entry> entries_; /**< most recently used entry first */
+		std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+		std::unordered_set<std::string> pinned_;
+		std::mutex mutex_;
+		static struct Stamp getStamp(std::string path);
+		static bool isEqual(const struct Stamp &a, const struct Stamp &b);
+		void erase(std::string macroPath);
+		void evict();
+};
+
+#endif
@@ -0,0 +1,322 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <core/logger.hpp>
+
+#include "macro_engine.hpp"
+
+constexpr auto MAX_INSTRUCTIONS =	4096;
+constexpr auto MAX_LATENESS =		1000000LL;
+constexpr auto SCALE_PERCENT =		100LL;
+
+/*
+ * Called macros are looked up in the directory of the calling macro, e.g.
+ * profile_1/s3.xml calls profile_1/s5.xml.
+ */
+static std::string getCallPath(std::string path, int index) {
+	std::stringstream callPath;
+	callPath << path.substr(0, path.rfind('/') + 1) << "s" << index << ".xml";
+
+	return callPath.str();
+}
+
+void MacroEngine::play(std::shared_ptr<const Macro> macro, long long origin) {
+	if (!macro) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (running_ >= MAX_PLAYBACKS) {
+		LOGGER_WARNING("Too many macros running, skipping macro.");
+
+		return;
+	}
+
+	pending_.push_back(Playback());
+	auto &playback = pending_.back();
+	playback.frames[0].macro = macro;
+	playback.nFrames = 1;
+	playback.origin = origin;
+	std::fill(playback.variables, playback.variables + MAX_MACRO_VARIABLES, MACRO_VARIABLE_DEFAULT);
+	running_++;
+	uint64_t value = 1;
+	write(eventfd_, &value, sizeof(value));
+}
+
+/*
+ * Runs on the event loop. Moves all pending macros into playbacks and plays
+ * them, until their first delay.
+ */
+void MacroEngine::start() {
+	uint64_t value;
+	read(eventfd_, &value, sizeof(value));
+	std::list<Playback> pending;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending.swap(pending_);
+	}
+
+	while (!pending.empty()) {
+		auto playback = pending.begin();
+		playbacks_.splice(playbacks_.end(), pending, playback);
+		playback->scheduler.start();
+		step(playback);
+	}
+
+	arm();
+}
+
+/*
+ * Runs on the event loop. Continues all playbacks, whose deadline has passed.
+ */
+void MacroEngine::expire() {
+	uint64_t value;
+	read(timerfd_, &value, sizeof(value));
+	auto now = MacroScheduler::now();
+
+	while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+		auto playback = deadlines_.begin()->second;
+		deadlines_.erase(deadlines_.begin());
+		step(playback);
+	}
+
+	arm();
+}
+
+/*
+ * Sends events of a playback as frames, until the next delay is reached or
+ * the macro has finished. Long runs without delays are split up, so other
+ * devices aren't blocked by a macro repeating many times.
+ */
+void MacroEngine::step(std::list<Playback>::iterator playback) {
+	InputFrame frame;
+	std::size_t nInstructions = 0;
+
+	while (playback->nFrames) {
+		auto &current = playback->frames[playback->nFrames - 1];
+
+		if (current.position >= current.macro->size()) {
+			// return to calling macro
+			current.macro.reset();
+			playback->nFrames--;
+			continue;
+		}
+
+		auto &event = (*current.macro)[current.position];
+		auto delay = getDelay(*playback, event);
+
+		if (delay && !playback->isDue) {
+			// wait for deadline, continue in expire()
+			send(playback, &frame);
+			auto deadline = playback->scheduler.advance(delay);
+			playback->isDue = true;
+			deadlines_.insert(std::make_pair(deadline, playback));
+
+			return;
+		}
+
+		if (playback->isDue) {
+			playback->scheduler.record();
+			playback->isDue = false;
+		} else if (++nInstructions > MAX_INSTRUCTIONS) {
+			// continue on the next iteration of the event loop
+			send(playback, &frame);
+			deadlines_.insert(std::make_pair(MacroScheduler::now(), playback));
+
+			return;
+		}
+
+		if (event.type >= MACRO_OP_REPEAT) {
+			if (execute(playback, event)) {
+				LOGGER_WARNING("Macro is nested too deeply, stopping macro.");
+				break;
+			}
+
+			continue;
+		}
+
+		if (event.type != EV_SYN && !frame.add(event.type, event.code, event.value)) {
+			send(playback, &frame);
+			frame.add(event.type, event.code, event.value);
+		}
+
+		current.position++;
+	}
+
+	send(playback, &frame);
+
+	if (playback->hasSent) {
+		stats_->record(LatencyStats::Stage::FinalEvent, playback->latency);
+	}
+
+	if (playback->scheduler.getMaxLateness() > MAX_LATENESS) {
+		LOGGER_WARNING("Macro played %zu events late, mean: %lld us, max: %lld us",
+			playback->scheduler.getEvents(),
+			playback->scheduler.getMeanLateness() / 1000,
+			playback->scheduler.getMaxLateness() / 1000);
+	}
+
+	playbacks_.erase(playback);
+	std::lock_guard<std::mutex> lock(mutex_);
+	running_--;
+}
+
+/*
+ * Executes a control instruction and moves on to the next instruction.
+ * Returns -1, if the playback can't continue.
+ */
+int MacroEngine::execute(std::list<Playback>::iterator playback, const struct MacroEvent &event) {
+	auto &current = playback->frames[playback->nFrames - 1];
+	current.position++;
+
+	switch (event.type) {
+		case MACRO_OP_REPEAT:
+			if (event.value <= 0) {
+				// skip block including its end
+				current.position += event.code;
+			} else if (playback->nLoops == MAX_MACRO_DEPTH) {
+				return -1;
+			} else {
+				playback->loops[playback->nLoops++] = event.value;
+			}
+
+			break;
+		case MACRO_OP_END:
+			if (!playback->nLoops) {
+				return -1;
+			}
+
+			if (--playback->loops[playback->nLoops - 1] > 0) {
+				// jump to first instruction of the block
+				current.position -= event.code;
+			} else {
+				playback->nLoops--;
+			}
+
+			break;
+		case MACRO_OP_CALL: {
+			if (playback->nFrames == MAX_MACRO_DEPTH) {
+				return -1;
+			}
+
+			auto macro = macroCache_->get(getCallPath(current.macro->getPath(), event.value));
+
+			if (!macro) {
+				LOGGER_WARNING("Can't load called macro %d.", event.value);
+				break;
+			}
+
+			playback->frames[playback->nFrames++] = Frame{macro, 0};
+			break;
+		}
+		case MACRO_OP_SET:
+			playback->variables[event.code] = event.value;
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Delays of MACRO_OP_DELAY are scaled by a variable in percent and add to the
+ * delay, which has been attached to the instruction.
+ */
+uint32_t MacroEngine::getDelay(const struct Playback &playback, const struct MacroEvent &event) {
+	if (event.type != MACRO_OP_DELAY || event.value <= 0
+			|| playback.variables[event.code] <= 0) {
+		return event.delay;
+	}
+
+	long long scaled = static_cast<long long>(event.value) * playback.variables[event.code] / SCALE_PERCENT;
+
+	return std::min<long long>(scaled + event.delay, UINT32_MAX);
+}
+
+/*
+ * Sends frame and records latency relative to the triggering input. Delays of
+ * the macro itself are subtracted, so only latency added by us is counted.
+ */
+void MacroEngine::send(std::list<Playback>::iterator playback, InputFrame *frame) {
+	if (frame->isEmpty()) {
+		return;
+	}
+
+	virtInput_->sendFrame(frame);
+
+	if (!playback->origin) {
+		return;
+	}
+
+	auto now = MacroScheduler::now();
+	playback->latency = now - playback->origin - playback->scheduler.getDuration();
+
+	if (!playback->hasSent) {
+		playback->hasSent = true;
+		stats_->record(LatencyStats::Stage::FirstEvent, now - playback->origin);
+	}
+}
+
+/*
+ * Arms timerfd with the earliest deadline or disarms it, if there are none.
+ */
+void MacroEngine::arm() {
+	struct itimerspec spec = itimerspec();
+
+	if (!deadlines_.empty()) {
+		auto deadline = deadlines_.begin()->first;
+		spec.it_value.tv_sec = deadline / NSEC_PER_SEC;
+		spec.it_value.tv_nsec = deadline % NSEC_PER_SEC;
+	}
+
+	timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+int MacroEngine::watch() {
+	if (reactor_->add(eventfd_, EPOLLIN, [this](uint32_t) { start(); })
+			|| reactor_->add(timerfd_, EPOLLIN, [this](uint32_t) { expire(); })) {
+		return -1;
+	}
+
+	return 0;
+}
+
+MacroEngine::MacroEngine(Reactor *reactor, VirtualInput *virtInput, MacroCache *macroCache, LatencyStats *stats) {
+	reactor_ = reactor;
+	virtInput_ = virtInput;
+	macroCache_ = macroCache;
+	stats_ = stats;
+	running_ = 0;
+	eventfd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+	if (eventfd_ < 0 || timerfd_ < 0) {
+		LOGGER_ERROR("Can't create macro engine.");
+	}
+}
+
+MacroEngine::~MacroEngine() {
+	// after removal, no callbacks are running and playbacks can be dropped
+	reactor_->remove(eventfd_);
+	reactor_->remove(timerfd_);
+	close(eventfd_);
+	close(timerfd_);
+}
@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef MACRO_ENGINE_CLASS_H
+#define MACRO_ENGINE_CLASS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <core/latency_stats.hpp>
+#include <core/macro_cache.hpp>
+#include <core/macro_scheduler.hpp>
+#include <core/reactor.hpp>
+#include <core/virtual_input.hpp>
+
+/* constants */
+const std::size_t MAX_PLAYBACKS = 64;
+
+/**
+ * Class playing macros on an event loop.
+ *
+ * Every running macro is a playback, which interprets the macro's
+ * instructions. It remembers its position, loop counters, variables and called
+ * macros in fixed size arrays, so a playback takes the same memory, however
+ * often a macro repeats. Delays are handled by a single timerfd per engine,
+ * so no threads are needed, regardless of how many macros are running at the
+ * same time.
+ */
+class MacroEngine {
+	public:
+		/**
+		 * Starts playing a macro. Can be called from any thread.
+		 * @param macro compiled macro, nullptr is ignored
+		 * @param origin CLOCK_MONOTONIC time of the input triggering the
+		 * macro, latency isn't recorded if 0
+		 */
+		void play(std::shared_ptr<const Macro> macro, long long origin);
+
+		/**
+		 * Connects engine to the event loop. The constructor doesn't touch
+		 * the event loop, so engines can be created on any thread.
+		 * @return 0 on success, -1 on error
+		 */
+		int watch();
+		MacroEngine(Reactor *reactor, VirtualInput *virtInput, MacroCache *macroCache, LatencyStats *stats);
+		~MacroEngine();
+
+	private:
+		struct Frame {
+			std::shared_ptr<const Macro> macro;
+			std::size_t position; /**< index of next instruction */
+		};
+
+		struct Playback {
+			struct Frame frames[MAX_MACRO_DEPTH]; /**< calling macros first */
+			std::size_t nFrames;
+			int32_t loops[MAX_MACRO_DEPTH]; /**< iterations left per Repeat block */
+			std::size_t nLoops;
+			int32_t variables[MAX_MACRO_VARIABLES];
+			bool isDue; /**< delay of next instruction has already passed */
+			MacroScheduler scheduler;
+			long long origin; /**< time of triggering input */
+			long long latency; /**< latency of last sent frame, excluding delays */
+			bool hasSent; /**< first frame has been sent */
+		};
+
+		int eventfd_; /**< signals pending macros */
+		int timerfd_; /**< fires on the earliest deadline */
+		Reactor *reactor_;
+		VirtualInput *virtInput_;
+		MacroCache *macroCache_; /**< resolves called macros */
+		LatencyStats *stats_;
+		std::size_t running_; /**< number of pending and playing macros */
+		std::mutex mutex_; /**< protects pending_ and running_ */
+		std::list<Playback> pending_; /**< spliced into playbacks_ without allocating */
+		std::list<Playback> playbacks_;
+		std::multimap<long long, std::list<Playback>::iterator> deadlines_;
+		void start();
+		void expire();
+		void step(std::list<Playback>::iterator playback);
+		int execute(std::list<Playback>::iterator playback, const struct MacroEvent &event);
+		static uint32_t getDelay(const struct Playback &playback, const struct MacroEvent &event);
+		void send(std::list<Playback>::iterator playback, InputFrame *frame);
+		void arm();
+};
+
+#endif
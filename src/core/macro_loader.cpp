@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <chrono>
+#include <set>
+
+#include <dirent.h>
+
+#include <core/logger.hpp>
+
+#include "macro_loader.hpp"
+
+void MacroLoader::load(std::string directory) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	directory_ = directory;
+	isPending_ = true;
+	cv_.notify_one();
+}
+
+void MacroLoader::run() {
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (true) {
+		cv_.wait(lock, [this] { return isPending_ || !isRunning_; });
+
+		if (!isRunning_) {
+			break;
+		}
+
+		auto directory = directory_;
+		isPending_ = false;
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		auto paths = list(directory);
+		cache_->pin(paths);
+		std::size_t nLoaded = 0;
+
+		for (auto &path : paths) {
+			// stop early, if the profile has been switched again
+			if (isSuperseded()) {
+				break;
+			}
+
+			cache_->get(path);
+			nLoaded++;
+		}
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		LOGGER_DEBUG("Loaded %zu of %zu macros of %s in %lld us.", nLoaded, paths.size(), directory.c_str(), static_cast<long long>(elapsed.count()));
+
+		lock.lock();
+	}
+}
+
+bool MacroLoader::isSuperseded() {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	return isPending_ || !isRunning_;
+}
+
+/*
+ * Lists macro paths within a profile directory. Binary macros are listed by
+ * their XML path, as macros are always looked up by XML path.
+ */
+std::vector<std::string> MacroLoader::list(std::string directory) {
+	std::set<std::string> paths;
+	DIR *dir = opendir(directory.c_str());
+
+	if (!dir) {
+		return std::vector<std::string>();
+	}
+
+	while (struct dirent *entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		auto pos = name.rfind('.');
+
+		if (pos == std::string::npos) {
+			continue;
+		}
+
+		auto extension = name.substr(pos);
+
+		if (extension == ".xml") {
+			paths.insert(directory + name);
+		} else if (extension == ".bin") {
+			paths.insert(directory + name.substr(0, pos) + ".xml");
+		}
+	}
+
+	closedir(dir);
+
+	return std::vector<std::string>(paths.begin(), paths.end());
+}
+
+MacroLoader::MacroLoader(MacroCache *cache) {
+	cache_ = cache;
+	isPending_ = false;
+	isRunning_ = true;
+	thread_ = std::thread(&MacroLoader::run, this);
+}
+
+MacroLoader::~MacroLoader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		isRunning_ = false;
+		cv_.notify_one();
+	}
+
+	thread_.join();
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef MACRO_LOADER_CLASS_H
+#define MACRO_LOADER_CLASS_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <core/macro_cache.hpp>
+
+/**
+ * Class loading all macros of a profile in the background.
+ *
+ * Macros are compiled on a worker thread and pinned in the cache, so the
+ * first press of a key after a profile switch doesn't touch the disk. A new
+ * request supersedes a running one.
+ */
+class MacroLoader {
+	public:
+		/**
+		 * Loads and pins all macros within a profile directory.
+		 * @param directory profile directory, ending with a slash
+		 */
+		void load(std::string directory);
+		MacroLoader(MacroCache *cache);
+		~MacroLoader();
+
+	private:
+		MacroCache *cache_;
+		std::string directory_; /**< requested profile directory */
+		bool isPending_;
+		bool isRunning_;
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		std::thread thread_;
+		void run();
+		bool isSuperseded();
+		static std::vector<std::string> list(std::string directory);
+};
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <ctime>
+
+#include "macro_scheduler.hpp"
+
+void MacroScheduler::start() {
+	start_ = now();
+	deadline_ = start_;
+	events_ = 0;
+	maxLateness_ = 0;
+	totalLateness_ = 0;
+}
+
+long long MacroScheduler::advance(unsigned int delay) {
+	deadline_ += delay * NSEC_PER_MSEC;
+
+	return deadline_;
+}
+
+long long MacroScheduler::record() {
+	long long lateness = now() - deadline_;
+
+	if (lateness < 0) {
+		lateness = 0;
+	}
+
+	events_++;
+	totalLateness_ += lateness;
+
+	if (lateness > maxLateness_) {
+		maxLateness_ = lateness;
+	}
+
+	return lateness;
+}
+
+long long MacroScheduler::getDuration() {
+	return deadline_ - start_;
+}
+
+std::size_t MacroScheduler::getEvents() {
+	return events_;
+}
+
+long long MacroScheduler::getMaxLateness() {
+	return maxLateness_;
+}
+
+long long MacroScheduler::getMeanLateness() {
+	if (!events_) {
+		return 0;
+	}
+
+	return totalLateness_ / static_cast<long long>(events_);
+}
+
+long long MacroScheduler::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+MacroScheduler::MacroScheduler() {
+	start();
+}
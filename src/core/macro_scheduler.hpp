@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef MACRO_SCHEDULER_CLASS_H
+#define MACRO_SCHEDULER_CLASS_H
+
+#include <cstddef>
+
+/* constants */
+const long long NSEC_PER_MSEC = 1000000LL;
+const long long NSEC_PER_SEC = 1000000000LL;
+
+/**
+ * Class scheduling macro events on absolute deadlines.
+ *
+ * All deadlines are computed from the start of the macro on CLOCK_MONOTONIC,
+ * so timer overshoot and the time needed for sending events don't add up over
+ * the course of a long macro. All times are given in nanoseconds.
+ */
+class MacroScheduler {
+	public:
+		/**
+		 * Sets the start of the macro to the current time.
+		 */
+		void start();
+
+		/**
+		 * Advances the deadline.
+		 * @param delay delay in milliseconds relative to previous deadline
+		 * @return absolute deadline of next event
+		 */
+		long long advance(unsigned int delay);
+
+		/**
+		 * Records lateness of the current deadline.
+		 * @return lateness of this event
+		 */
+		long long record();
+
+		/**
+		 * Returns the sum of all delays advanced so far.
+		 */
+		long long getDuration();
+		std::size_t getEvents();
+		long long getMaxLateness();
+		long long getMeanLateness();
+
+		/**
+		 * Returns current time of CLOCK_MONOTONIC.
+		 */
+		static long long now();
+		MacroScheduler();
+
+	private:
+		long long start_; /**< absolute start of the macro */
+		long long deadline_; /**< absolute deadline of current event */
+		std::size_t events_; /**< number of recorded events */
+		long long maxLateness_; /**< maximum lateness */
+		long long totalLateness_; /**< sum of all latenesses */
+};
+
+#endif
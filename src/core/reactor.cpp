@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cerrno>
+
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <core/logger.hpp>
+#include <core/macro_scheduler.hpp>
+
+#include "reactor.hpp"
+
+constexpr auto MAX_EVENTS =	16;
+
+int Reactor::add(int fd, uint32_t events, Callback callback) {
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+	struct epoll_event ev = epoll_event();
+	ev.events = events;
+	ev.data.fd = fd;
+
+	if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		LOGGER_ERROR("Can't add file descriptor to event loop.");
+
+		return -1;
+	}
+
+	callbacks_[fd] = std::make_shared<Callback>(callback);
+
+	return 0;
+}
+
+int Reactor::modify(int fd, uint32_t events) {
+	struct epoll_event ev = epoll_event();
+	ev.events = events;
+	ev.data.fd = fd;
+
+	if (epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) < 0) {
+		LOGGER_ERROR("Can't modify file descriptor in event loop.");
+
+		return -1;
+	}
+
+	return 0;
+}
+
+void Reactor::remove(int fd) {
+	// waits for the event loop, if it's currently dispatching callbacks
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+	auto it = callbacks_.find(fd);
+
+	if (it != callbacks_.end()) {
+		epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+		callbacks_.erase(it);
+	}
+}
+
+void Reactor::run() {
+	struct epoll_event events[MAX_EVENTS];
+
+	while (isRunning_) {
+		// no timeout, we're woken up by file descriptors only
+		int nfds = epoll_wait(epfd_, events, MAX_EVENTS, -1);
+
+		if (nfds < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			LOGGER_ERROR("Error waiting for events.");
+			break;
+		}
+
+		wakeup_ = MacroScheduler::now();
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+		for (int i = 0; i < nfds; i++) {
+			auto it = callbacks_.find(events[i].data.fd);
+
+			// callback might have been removed by a previous callback
+			if (it == callbacks_.end()) {
+				continue;
+			}
+
+			// keep callback alive, even if it removes itself
+			auto callback = it->second;
+			(*callback)(events[i].events);
+		}
+	}
+}
+
+void Reactor::stop() {
+	isRunning_ = false;
+	uint64_t value = 1;
+	write(wakefd_, &value, sizeof(value));
+}
+
+long long Reactor::getWakeup() {
+	return wakeup_;
+}
+
+Reactor::Reactor() {
+	isRunning_ = true;
+	wakeup_ = 0;
+	epfd_ = epoll_create1(EPOLL_CLOEXEC);
+	wakefd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (epfd_ < 0 || wakefd_ < 0) {
+		LOGGER_ERROR("Can't create event loop.");
+	}
+
+	add(wakefd_, EPOLLIN, [this](uint32_t) {
+		uint64_t value;
+		read(wakefd_, &value, sizeof(value));
+	});
+}
+
+Reactor::~Reactor() {
+	close(wakefd_);
+	close(epfd_);
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef REACTOR_CLASS_H
+#define REACTOR_CLASS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/**
+ * Class implementing an epoll based event loop.
+ *
+ * File descriptors are registered together with a callback, which is invoked
+ * on the thread running the loop. Registering and removing file descriptors is
+ * thread safe. remove() waits for running callbacks to return, so a callback
+ * is never invoked after remove() has returned.
+ */
+class Reactor {
+	public:
+		typedef std::function<void(uint32_t events)> Callback;
+
+		/**
+		 * Registers file descriptor.
+		 * @param fd file descriptor to be watched
+		 * @param events epoll events, e.g. EPOLLIN
+		 * @param callback function called with the returned events
+		 * @return 0 on success, -1 on error
+		 */
+		int add(int fd, uint32_t events, Callback callback);
+
+		/**
+		 * Changes watched events of a registered file descriptor.
+		 * @param fd registered file descriptor
+		 * @param events epoll events, e.g. EPOLLIN | EPOLLOUT
+		 * @return 0 on success, -1 on error
+		 */
+		int modify(int fd, uint32_t events);
+
+		/**
+		 * Unregisters file descriptor.
+		 * @param fd file descriptor to be removed
+		 */
+		void remove(int fd);
+
+		/**
+		 * Runs the event loop, until stop() has been called.
+		 */
+		void run();
+
+		/**
+		 * Stops the event loop. Can be called from any thread.
+		 */
+		void stop();
+
+		/**
+		 * Returns CLOCK_MONOTONIC time in nanoseconds, when epoll_wait()
+		 * returned the events currently being dispatched. Only valid
+		 * within callbacks.
+		 */
+		long long getWakeup();
+		Reactor();
+		~Reactor();
+
+	private:
+		int epfd_; /**< epoll file descriptor */
+		int wakefd_; /**< eventfd for waking up the event loop */
+		std::atomic<bool> isRunning_;
+		long long wakeup_; /**< time of last wakeup */
+		std::recursive_mutex mutex_; /**< held while dispatching callbacks */
+		std::map<int, std::shared_ptr<Callback>> callbacks_;
+};
+
+#endif
@@ -6,7 +6,9 @@
  */
 
 #include <cstdio>
-#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -14,9 +16,59 @@
 #include <linux/uinput.h>
 
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+
+#include <core/logger.hpp>
 
 #include "virtual_input.hpp"
 
+/* keys a keyboard might send, advertised by default */
+constexpr struct KeyRange KEYBOARD_KEYS[] = {
+	{KEY_ESC, KEY_KPDOT},
+	{KEY_ZENKAKUHANKAKU, KEY_F24},
+	{KEY_PLAYCD, KEY_MICMUTE}
+};
+
+bool InputFrame::add(short type, short code, int value) {
+	if (size_ >= MAX_FRAME_EVENTS) {
+		return false;
+	}
+
+	for (std::size_t i = 0; i < size_; i++) {
+		if (events_[i].type == type && events_[i].code == code) {
+			return false;
+		}
+	}
+
+	events_[size_] = input_event();
+	events_[size_].type = type;
+	events_[size_].code = code;
+	events_[size_].value = value;
+	size_++;
+
+	return true;
+}
+
+void InputFrame::clear() {
+	size_ = 0;
+}
+
+bool InputFrame::isEmpty() {
+	return !size_;
+}
+
+std::size_t InputFrame::size() {
+	return size_;
+}
+
+struct input_event *InputFrame::data() {
+	return events_;
+}
+
+InputFrame::InputFrame() {
+	size_ = 0;
+}
+
 /**
  * Method for sending input events to the operating system.
  *
@@ -26,26 +78,53 @@
  * keypress and 2 autorepeat
  */
 void VirtualInput::sendEvent(short type, short code, int value) {
-	struct input_event inev = input_event();
-	inev.type = type;
-	inev.code = code;
-	inev.value = value;
-	write(uifd_, &inev, sizeof(struct input_event));
-	inev.type = EV_SYN;
-	inev.code = 0;
-	inev.value = 0;
-	write(uifd_, &inev, sizeof(struct input_event));
+	InputFrame frame;
+	frame.add(type, code, value);
+	sendFrame(&frame);
+}
+
+/**
+ * Method for sending a frame of input events to the operating system.
+ *
+ * The events and the terminating EV_SYN report are written with a single
+ * writev() call. The frame is cleared afterwards.
+ *
+ * @param frame events to be sent
+ */
+void VirtualInput::sendFrame(InputFrame *frame) {
+	if (frame->isEmpty()) {
+		return;
+	}
+
+	struct input_event syn = input_event();
+	syn.type = EV_SYN;
+	syn.code = SYN_REPORT;
+	syn.value = 0;
+	struct iovec iov[2];
+	iov[0].iov_base = frame->data();
+	iov[0].iov_len = frame->size() * sizeof(struct input_event);
+	iov[1].iov_base = &syn;
+	iov[1].iov_len = sizeof(struct input_event);
+	writev(uifd_, iov, 2);
+	frame->clear();
 }
 
 /**
  * Constructor setting up operating system specific back-ends.
  */
-VirtualInput::VirtualInput(struct Device *device, sidewinderd::DevNode *devNode, Process *process) {
+VirtualInput::VirtualInput(struct Device *device, sidewinderd::DevNode *devNode, Process *process, std::string keys) {
 	process_ = process;
 	device_ = device;
 	devNode_ = devNode;
 	/* for Linux */
-	createUidev();
+	createUidev(keys);
+}
+
+VirtualInput::VirtualInput(int fd) {
+	process_ = nullptr;
+	device_ = nullptr;
+	devNode_ = nullptr;
+	uifd_ = fd;
 }
 
 VirtualInput::~VirtualInput() {
@@ -55,45 +134,106 @@ VirtualInput::~VirtualInput() {
 /**
  * Creating a uinput virtual input device under Linux.
  */
-void VirtualInput::createUidev() {
+void VirtualInput::createUidev(std::string keys) {
+	// simulated device, events are captured by whoever reads the other end
+	if (devNode_->uinputFd >= 0) {
+		uifd_ = devNode_->uinputFd;
+
+		return;
+	}
+
+	std::vector<KeyRange> ranges;
+
+	if (parseKeys(keys, &ranges)) {
+		LOGGER_ERROR("Invalid keys %s for %s, using all keys.", keys.c_str(), device_->name.c_str());
+		ranges.clear();
+	}
+
 	/* open uinput device with root privileges */
 	process_->privilege();
-	uifd_ = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	uifd_ = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
 
 	if (uifd_ < 0) {
-		uifd_ = open("/dev/input/uinput", O_WRONLY | O_NONBLOCK);
-
-		if (uifd_ < 0) {
-			std::cout << "Can't open uinput" << std::endl;
-		}
+		uifd_ = open("/dev/input/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
 	}
 
 	process_->unprivilege();
-	/* set all keybits */
-	ioctl(uifd_, UI_SET_EVBIT, EV_KEY);
 
-	for (int i = KEY_ESC; i <= KEY_KPDOT; i++) {
-		ioctl(uifd_, UI_SET_KEYBIT, i);
+	if (uifd_ < 0) {
+		LOGGER_ERROR("Can't open uinput");
+
+		return;
 	}
 
-	for (int i = KEY_ZENKAKUHANKAKU; i <= KEY_F24; i++) {
-		ioctl(uifd_, UI_SET_KEYBIT, i);
+	if (setup(uifd_, device_, ranges)) {
+		LOGGER_ERROR("Can't create uinput device for %s.", device_->name.c_str());
 	}
+}
+
+int VirtualInput::parseKeys(std::string spec, std::vector<KeyRange> *keys) {
+	std::stringstream stream(spec);
+	std::string item;
+
+	while (std::getline(stream, item, ',')) {
+		char *end;
+		auto first = std::strtoul(item.c_str(), &end, 10);
+		auto last = first;
+
+		if (*end == '-') {
+			last = std::strtoul(end + 1, &end, 10);
+		}
 
-	for (int i = KEY_PLAYCD; i <= KEY_MICMUTE; i++) {
-		ioctl(uifd_, UI_SET_KEYBIT, i);
+		if (end == item.c_str() || *end || !first || first > last || last > KEY_MAX) {
+			return -1;
+		}
+
+		keys->push_back(KeyRange{static_cast<unsigned short>(first), static_cast<unsigned short>(last)});
+	}
+
+	return 0;
+}
+
+int VirtualInput::setup(int fd, const struct Device *device, const std::vector<KeyRange> &keys) {
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+
+	/* uinput has no call for setting several keybits at once */
+	if (keys.empty()) {
+		for (auto &range : KEYBOARD_KEYS) {
+			for (int i = range.first; i <= range.last; i++) {
+				ioctl(fd, UI_SET_KEYBIT, i);
+			}
+		}
+	} else {
+		for (auto &range : keys) {
+			for (int i = range.first; i <= range.last; i++) {
+				ioctl(fd, UI_SET_KEYBIT, i);
+			}
+		}
 	}
 
 	/* uinput device details */
-	struct uinput_user_dev uidev = uinput_user_dev();
-	/* TODO: copy device's name */
-	snprintf(uidev.name, UINPUT_MAX_NAME_SIZE, "Sidewinderd");
-	uidev.id.bustype = BUS_USB;
-	uidev.id.vendor = std::stoi(device_->vendor, nullptr, 16);
-	uidev.id.product = std::stoi(device_->product, nullptr, 16);
-	uidev.id.version = 1;
-	/* write uinput device details */
-	write(uifd_, &uidev, sizeof(struct uinput_user_dev));
+	struct uinput_setup setup = uinput_setup();
+	snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "%s", device->name.c_str());
+	setup.id.bustype = BUS_USB;
+	setup.id.vendor = std::stoi(device->vendor, nullptr, 16);
+	setup.id.product = std::stoi(device->product, nullptr, 16);
+	setup.id.version = 1;
+
+	if (ioctl(fd, UI_DEV_SETUP, &setup) < 0) {
+		// kernels before 4.5 only support writing the legacy struct
+		struct uinput_user_dev uidev = uinput_user_dev();
+		std::memcpy(uidev.name, setup.name, sizeof(uidev.name));
+		uidev.id = setup.id;
+
+		if (write(fd, &uidev, sizeof(uidev)) != sizeof(uidev)) {
+			return -1;
+		}
+	}
+
 	/* create uinput device */
-	ioctl(uifd_, UI_DEV_CREATE);
+	if (ioctl(fd, UI_DEV_CREATE) < 0) {
+		return -1;
+	}
+
+	return 0;
 }
@@ -8,10 +8,55 @@
 #ifndef VIRTUALINPUT_CLASS_H
 #define VIRTUALINPUT_CLASS_H
 
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <linux/input.h>
+
 #include <process.hpp>
 #include <device_data.hpp>
 #include <core/device.hpp>
 
+/* constants */
+const std::size_t MAX_FRAME_EVENTS = 64;
+
+/**
+ * Struct describing a range of key codes, both ends included.
+ */
+struct KeyRange {
+	unsigned short first;
+	unsigned short last;
+};
+
+/**
+ * Class collecting input events, which are sent as a single frame.
+ *
+ * All events of a frame are delivered at once, followed by a single EV_SYN
+ * report. This way, key combinations reach applications atomically.
+ */
+class InputFrame {
+	public:
+		/**
+		 * Appends event to frame.
+		 *
+		 * A key can only be part of a frame once, as a press and release of
+		 * the same key in a single report would get lost.
+		 * @return true on success, false if frame is full or key is
+		 * already part of this frame
+		 */
+		bool add(short type, short code, int value);
+		void clear();
+		bool isEmpty();
+		std::size_t size();
+		struct input_event *data();
+		InputFrame();
+
+	private:
+		struct input_event events_[MAX_FRAME_EVENTS];
+		std::size_t size_;
+};
+
 /**
  * Class representing a virtual input device.
  *
@@ -21,7 +66,36 @@
 class VirtualInput {
 	public:
 		void sendEvent(short type, short code, int value);
-		VirtualInput(struct Device *device, sidewinderd::DevNode *devNode, Process *process);
+		void sendFrame(InputFrame *frame);
+
+		/**
+		 * Parses key codes and ranges of key codes, e.g. "1-83,183-194".
+		 * @return 0 on success, -1 if spec is malformed
+		 */
+		static int parseKeys(std::string spec, std::vector<KeyRange> *keys);
+
+		/**
+		 * Registers keys and creates uinput device on an opened uinput
+		 * file descriptor.
+		 * @param keys advertised keys, empty for all keys a keyboard might
+		 * send
+		 * @return 0 on success, -1 on error
+		 */
+		static int setup(int fd, const struct Device *device, const std::vector<KeyRange> &keys);
+
+		/**
+		 * Constructor creating a uinput device.
+		 * @param keys advertised keys, see parseKeys(), empty for all
+		 * keys a keyboard might send. Macros can only send these keys.
+		 */
+		VirtualInput(struct Device *device, sidewinderd::DevNode *devNode, Process *process, std::string keys);
+
+		/**
+		 * Constructor writing to an already opened file descriptor
+		 * instead of a new uinput device, e.g. a pipe or /dev/null. Takes
+		 * ownership of the file descriptor.
+		 */
+		VirtualInput(int fd);
 		~VirtualInput();
 
 	private:
@@ -29,7 +103,7 @@ class VirtualInput {
 		Process *process_; /**< process object for setting privileges */
 		Device *device_; /**< device information */
 		sidewinderd::DevNode *devNode_; /**< device information */
-		void createUidev();
+		void createUidev(std::string keys);
 };
 
 #endif
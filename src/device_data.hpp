@@ -14,9 +14,18 @@
 namespace sidewinderd {
 	/**
 	 * Struct for storing and passing paths to relevant /dev/<node> files.
+	 *
+	 * Already opened file descriptors can be injected instead, e.g. a
+	 * socketpair standing in for hidraw and a pipe capturing uinput output.
+	 * The device takes ownership of injected file descriptors.
 	 */
 	struct DevNode {
 		std::string hidraw, inputEvent; /**< path to hidraw and input event */
+		std::string sysPath; /**< sysfs path of USB device, unique per device */
+		std::string id; /**< serial number or USB port, recognizes replugged devices */
+		std::string workdir; /**< profile directory, relative to working directory */
+		int hidrawFd = -1; /**< used instead of opening hidraw, if valid */
+		int uinputFd = -1; /**< used instead of creating a uinput device, if valid */
 	};
 };
 
@@ -10,10 +10,10 @@
 
 #include <getopt.h>
 
-#include <libconfig.h++>
-
 #include <process.hpp>
+#include <settings.hpp>
 #include <core/device_manager.hpp>
+#include <core/logger.hpp>
 
 void help(std::string name) {
 	std::cerr << "Usage: " << name << " [options]" << std::endl
@@ -25,34 +25,6 @@ void help(std::string name) {
 		  << "  -v, --version         Print program version" << std::endl;
 }
 
-void setupConfig(libconfig::Config *config, std::string configFilePath = "/etc/sidewinderd.conf") {
-	try {
-		config->readFile(configFilePath.c_str());
-	} catch (const libconfig::FileIOException &fioex) {
-		std::cerr << "I/O error while reading file." << std::endl;
-	} catch (const libconfig::ParseException &pex) {
-		std::cerr << "Parse error at " << pex.getFile() << ":" << pex.getLine() << " - " << pex.getError() << std::endl;
-	}
-
-	libconfig::Setting &root = config->getRoot();
-
-	if (!root.exists("user")) {
-		root.add("user", libconfig::Setting::TypeString) = "root";
-	}
-
-	if (!root.exists("capture_delays")) {
-		root.add("capture_delays", libconfig::Setting::TypeBoolean) = true;
-	}
-
-	if (!root.exists("pid-file")) {
-		root.add("pid-file", libconfig::Setting::TypeString) = "/var/run/sidewinderd.pid";
-	}
-
-	if (!root.exists("encrypted_workdir")) {
-		root.add("encrypted_workdir", libconfig::Setting::TypeBoolean) = false;
-	}
-}
-
 int main(int argc, char *argv[]) {
 	/* object for managing runtime information */
 	Process process;
@@ -102,14 +74,14 @@ int main(int argc, char *argv[]) {
 	}
 
 	/* reading config file */
-	libconfig::Config config;
-
 	if (configFilePath.empty()) {
-		setupConfig(&config);
-	} else {
-		setupConfig(&config, configFilePath);
+		configFilePath = "/etc/sidewinderd.conf";
 	}
 
+	SettingsStore settingsStore(configFilePath);
+	settingsStore.load();
+	auto settings = settingsStore.get();
+
 	/* daemonize, if flag has been set */
 	if (shouldDaemonize) {
 		int ret = process.daemonize();
@@ -121,35 +93,41 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	/* std fds are closed in daemon mode, so log to syslog instead */
+	if (!settings->logFile.empty()) {
+		if (Logger::get()->openFile(settings->logFile)) {
+			LOGGER_ERROR("Can't open log file %s.", settings->logFile.c_str());
+		}
+	} else if (shouldDaemonize) {
+		Logger::get()->openSyslog(process.getName());
+	}
+
+	/* threads don't survive fork, so start logging thread afterwards */
+	Logger::get()->start();
+
 	/* creating pid file for single instance mechanism */
-	if (process.createPid(config.lookup("pid-file"))) {
+	if (process.createPid(settings->pidFile)) {
 		return EXIT_FAILURE;
 	}
 
 	/* setting gid and uid to configured user */
-	if (process.applyUser(config.lookup("user"))) {
+	if (process.applyUser(settings->user)) {
 		return EXIT_FAILURE;
 	}
 
 	// setting up working directory
-	std::string workdir;
-
-	if (config.exists("workdir")) {
-		workdir = config.lookup("workdir").c_str();
-	}
-
-	if (process.createWorkdir(workdir, config.lookup("encrypted_workdir"))) {
+	if (process.createWorkdir(settings->workdir, settings->encryptedWorkdir)) {
 		return EXIT_FAILURE;
 	}
 
-	std::clog << "Started sidewinderd." << std::endl;
+	LOGGER_INFO("Started sidewinderd.");
 	process.setActive(true);
 
-	DeviceManager deviceManager(&config, &process);
+	DeviceManager deviceManager(&settingsStore, &process);
 
 	deviceManager.monitor();
 	process.destroyPid();
-	std::clog << "Stopped sidewinderd." << std::endl;
+	LOGGER_INFO("Stopped sidewinderd.");
 
 	return EXIT_SUCCESS;
 }
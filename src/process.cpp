@@ -5,23 +5,30 @@
  * MIT License. For more information, see LICENSE file.
  */
 
+#include <cerrno>
 #include <chrono>
 #include <csignal>
-#include <iostream>
 #include <thread>
 
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <core/logger.hpp>
+
 #include "process.hpp"
 
 /* constants */
 constexpr auto version =	"0.4.4";
 constexpr auto wait =		1;
+constexpr auto INOTIFY_BUFFER_SIZE =	4096;
 
 std::atomic<bool> Process::isActive_;
 
@@ -50,7 +57,7 @@ int Process::daemonize() {
 	pid = fork();
 
 	if (pid < 0) {
-		std::cerr << "Error creating daemon." << std::endl;
+		LOGGER_ERROR("Error creating daemon.");
 		return -1;
 	}
 
@@ -61,14 +68,14 @@ int Process::daemonize() {
 	sid = setsid();
 
 	if (sid < 0) {
-		std::cerr << "Error setting sid." << std::endl;
+		LOGGER_ERROR("Error setting sid.");
 		return -1;
 	}
 
 	pid = fork();
 
 	if (pid < 0) {
-		std::cerr << "Error forking second time." << std::endl;
+		LOGGER_ERROR("Error forking second time.");
 		return -1;
 	}
 
@@ -90,13 +97,13 @@ int Process::createPid(std::string pidPath) {
 	pidFd_ = open(pidPath_.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 
 	if (pidFd_ < 0) {
-		std::cerr << "PID file could not be created." << std::endl;
+		LOGGER_ERROR("PID file could not be created.");
 
 		return -1;
 	}
 
 	if (flock(pidFd_, LOCK_EX | LOCK_NB) < 0) {
-		std::cerr << "Could not lock PID file, another instance is already running." << std::endl;
+		LOGGER_ERROR("Could not lock PID file, another instance is already running.");
 		close(pidFd_);
 
 		return -1;
@@ -127,7 +134,7 @@ int Process::applyUser(std::string user) {
 		setegid(pw_->pw_gid);
 		seteuid(pw_->pw_uid);
 	} else {
-		std::cerr << "User not found." << std::endl;
+		LOGGER_ERROR("User not found.");
 
 		return -1;
 	}
@@ -163,10 +170,12 @@ int Process::createWorkdir(std::string directory, bool isEncrypted) {
 	}
 
 	// wait until encrypted drive becomes available
-	if (isEncrypted) {
-		while (access(workdir.c_str(), F_OK)) {
-			std::this_thread::sleep_for(std::chrono::seconds(wait));
-		}
+	if (isEncrypted && access(workdir.c_str(), F_OK)) {
+		LOGGER_INFO("Waiting for %s.", workdir.c_str());
+		auto start = std::chrono::steady_clock::now();
+		waitForPath(workdir);
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		LOGGER_INFO("%s became available after %lld ms.", workdir.c_str(), static_cast<long long>(elapsed.count()));
 	}
 
 	// creating sidewinderd directory
@@ -176,7 +185,7 @@ int Process::createWorkdir(std::string directory, bool isEncrypted) {
 	}
 
 	if (chdir(workdir.c_str())) {
-		std::cerr << "Error accessing " << workdir << "." << std::endl;
+		LOGGER_ERROR("Error accessing %s.", workdir.c_str());
 
 		return -1;
 	}
@@ -184,16 +193,110 @@ int Process::createWorkdir(std::string directory, bool isEncrypted) {
 	return 0;
 }
 
+/*
+ * Blocks, until path exists. The deepest existing parent directory is watched
+ * with inotify, as it is the one, which the next path component appears in.
+ * Encrypted home directories are usually mounted over an existing directory,
+ * which doesn't generate inotify events, so changes of the mount table wake us
+ * up as well. If inotify isn't available, we fall back to polling.
+ */
+void Process::waitForPath(std::string path) {
+	int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	int mountFd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+
+	while (access(path.c_str(), F_OK)) {
+		std::string parent = path;
+		int watch = -1;
+
+		do {
+			auto pos = parent.rfind('/');
+
+			if (pos == std::string::npos) {
+				parent = ".";
+				break;
+			}
+
+			parent = pos ? parent.substr(0, pos) : "/";
+		} while (parent.size() > 1 && access(parent.c_str(), F_OK));
+
+		if (inotifyFd >= 0) {
+			watch = inotify_add_watch(inotifyFd, parent.c_str(), IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+		}
+
+		// path might have appeared, before the watch has been added
+		if (!access(path.c_str(), F_OK)) {
+			break;
+		}
+
+		struct pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {mountFd, POLLPRI, 0}};
+		int timeout = watch < 0 ? wait * 1000 : -1;
+
+		if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+			std::this_thread::sleep_for(std::chrono::seconds(wait));
+		}
+
+		char buf[INOTIFY_BUFFER_SIZE];
+
+		while (inotifyFd >= 0 && read(inotifyFd, buf, sizeof(buf)) > 0) {}
+
+		if (watch >= 0) {
+			inotify_rm_watch(inotifyFd, watch);
+		}
+	}
+
+	if (inotifyFd >= 0) {
+		close(inotifyFd);
+	}
+
+	if (mountFd >= 0) {
+		close(mountFd);
+	}
+}
+
+/*
+ * Blocks stop signals and SIGUSR1 and returns a file descriptor, which becomes
+ * readable once one of them has been received. This way, signals can be
+ * handled by the event loop without any timeouts. Signals are only blocked on
+ * the calling thread and threads started by it afterwards, threads started
+ * before must block them on their own.
+ */
+int Process::createSignalFd() {
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+	int fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+	if (fd < 0) {
+		LOGGER_ERROR("Can't create signalfd.");
+	}
+
+	return fd;
+}
+
+/*
+ * The effective user id is shared by all threads, so devices, which are set
+ * up in parallel, take turns.
+ */
 void Process::privilege() {
+	privilegeMutex_.lock();
 	seteuid(0);
 }
 
 void Process::unprivilege() {
-	if (user_.empty()) {
-		return;
+	if (!user_.empty()) {
+		seteuid(pw_->pw_uid);
 	}
 
-	seteuid(pw_->pw_uid);
+	privilegeMutex_.unlock();
+}
+
+void Process::runUnprivileged(const std::function<void()> &function) {
+	std::lock_guard<std::mutex> lock(privilegeMutex_);
+	function();
 }
 
 std::string Process::getVersion() {
@@ -201,7 +304,9 @@ std::string Process::getVersion() {
 }
 
 void Process::sigHandler(int sig) {
-	std::cerr << std::endl << "Stop signal received." << std::endl;
+	// only async-signal-safe functions may be called here
+	const char message[] = "\nStop signal received.\n";
+	write(STDERR_FILENO, message, sizeof(message) - 1);
 
 	switch(sig) {
 		case SIGINT:
@@ -9,6 +9,8 @@
 #define PROCESS_CLASS_H
 
 #include <atomic>
+#include <functional>
+#include <mutex>
 #include <string>
 
 #include <pwd.h>
@@ -24,8 +26,21 @@ class Process {
 		void destroyPid();
 		int applyUser(std::string user);
 		int createWorkdir(std::string directory, bool isEncrypted);
+		int createSignalFd();
+
+		/**
+		 * Switches to root privileges, until unprivilege() is called.
+		 * Calls must be paired and can be made from any thread.
+		 */
 		void privilege();
 		void unprivilege();
+
+		/**
+		 * Runs function with the privileges of the configured user, while
+		 * no other thread has switched to root privileges. Files created
+		 * meanwhile are owned by the configured user.
+		 */
+		void runUnprivileged(const std::function<void()> &function);
 		std::string getVersion();
 		Process();
 		~Process();
@@ -38,7 +53,9 @@ class Process {
 		std::string user_;
 		std::string pidPath_;
 		struct passwd *pw_;
+		std::mutex privilegeMutex_;
 		static void sigHandler(int sig);
+		void waitForPath(std::string path);
 };
 
 #endif
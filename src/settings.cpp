@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <climits>
+#include <cstdlib>
+
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <libconfig.h++>
+
+#include <core/logger.hpp>
+
+#include "settings.hpp"
+
+constexpr auto INOTIFY_BUFFER_SIZE =	4096;
+
+std::shared_ptr<const Settings> SettingsStore::get() const {
+	return std::atomic_load(&settings_);
+}
+
+int SettingsStore::load() {
+	auto settings = std::make_shared<Settings>();
+	int ret = parse(settings.get());
+	auto current = get();
+
+	if (ret && current) {
+		// keep running with the last valid configuration
+		return ret;
+	}
+
+	if (current && (current->user != settings->user
+			|| current->pidFile != settings->pidFile
+			|| current->workdir != settings->workdir
+			|| current->encryptedWorkdir != settings->encryptedWorkdir
+			|| current->controlSocket != settings->controlSocket
+			|| current->logFile != settings->logFile)) {
+		LOGGER_WARNING("Changes to user, pid-file, workdir, control_socket and log_file take effect after restart.");
+	}
+
+	LogLevel level = LogLevel::Info;
+
+	if (Logger::parseLevel(settings->logLevel, &level)) {
+		LOGGER_ERROR("Unknown log_level %s.", settings->logLevel.c_str());
+	}
+
+	Logger::get()->setLevel(level);
+	std::atomic_store(&settings_, std::shared_ptr<const Settings>(settings));
+
+	return ret;
+}
+
+int SettingsStore::parse(struct Settings *settings) {
+	libconfig::Config config;
+	int ret = 0;
+
+	try {
+		config.readFile(path_.c_str());
+	} catch (const libconfig::FileIOException &fioex) {
+		LOGGER_ERROR("I/O error while reading file.");
+		ret = -1;
+	} catch (const libconfig::ParseException &pex) {
+		LOGGER_ERROR("Parse error at %s:%d - %s", pex.getFile(), pex.getLine(), pex.getError());
+		ret = -1;
+	}
+
+	// default values
+	settings->user = "root";
+	settings->pidFile = "/var/run/sidewinderd.pid";
+	settings->encryptedWorkdir = false;
+	settings->captureDelays = true;
+	settings->controlSocket = "sidewinderd.sock";
+	settings->logLevel = "info";
+	settings->gracePeriod = 30;
+
+	config.lookupValue("user", settings->user);
+	config.lookupValue("pid-file", settings->pidFile);
+	config.lookupValue("workdir", settings->workdir);
+	config.lookupValue("encrypted_workdir", settings->encryptedWorkdir);
+	config.lookupValue("capture_delays", settings->captureDelays);
+	config.lookupValue("control_socket", settings->controlSocket);
+	config.lookupValue("log_level", settings->logLevel);
+	config.lookupValue("log_file", settings->logFile);
+	config.lookupValue("grace_period", settings->gracePeriod);
+
+	if (config.exists("devices")) {
+		const libconfig::Setting &devices = config.lookup("devices");
+
+		for (int i = 0; i < devices.getLength(); i++) {
+			std::string id, keys;
+
+			if (devices[i].lookupValue("id", id) && devices[i].lookupValue("keys", keys)) {
+				settings->deviceKeys[id] = keys;
+			}
+		}
+	}
+
+	return ret;
+}
+
+int SettingsStore::watch(Reactor *reactor) {
+	inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (inotifyFd_ < 0) {
+		LOGGER_ERROR("Can't watch configuration file.");
+
+		return -1;
+	}
+
+	/*
+	 * watching the directory instead of the file itself, as editors
+	 * usually replace the file instead of writing to it
+	 */
+	if (inotify_add_watch(inotifyFd_, directory_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0
+			|| reactor->add(inotifyFd_, EPOLLIN, [this](uint32_t) { receive(); })) {
+		LOGGER_ERROR("Can't watch configuration file.");
+		close(inotifyFd_);
+		inotifyFd_ = -1;
+
+		return -1;
+	}
+
+	reactor_ = reactor;
+
+	return 0;
+}
+
+void SettingsStore::unwatch() {
+	if (reactor_) {
+		reactor_->remove(inotifyFd_);
+		reactor_ = nullptr;
+	}
+
+	if (inotifyFd_ >= 0) {
+		close(inotifyFd_);
+		inotifyFd_ = -1;
+	}
+}
+
+/*
+ * Drains all pending inotify events and reloads at most once per wakeup.
+ */
+void SettingsStore::receive() {
+	alignas(struct inotify_event) char buf[INOTIFY_BUFFER_SIZE];
+	bool isChanged = false;
+	ssize_t nBytes;
+
+	while ((nBytes = ::read(inotifyFd_, buf, sizeof(buf))) > 0) {
+		for (char *ptr = buf; ptr < buf + nBytes;) {
+			auto event = reinterpret_cast<struct inotify_event *>(ptr);
+
+			if (event->len && name_ == event->name) {
+				isChanged = true;
+			}
+
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	if (isChanged && !load()) {
+		LOGGER_INFO("Reloaded %s.", path_.c_str());
+	}
+}
+
+std::string SettingsStore::getPath() {
+	return path_;
+}
+
+SettingsStore::SettingsStore(std::string path) {
+	// the working directory changes after startup, so relative paths break
+	char resolved[PATH_MAX];
+
+	if (realpath(path.c_str(), resolved)) {
+		path_ = resolved;
+	} else {
+		path_ = path;
+	}
+
+	auto pos = path_.rfind('/');
+
+	if (pos == std::string::npos) {
+		directory_ = ".";
+		name_ = path_;
+	} else {
+		directory_ = pos ? path_.substr(0, pos) : "/";
+		name_ = path_.substr(pos + 1);
+	}
+
+	inotifyFd_ = -1;
+	reactor_ = nullptr;
+}
+
+SettingsStore::~SettingsStore() {
+	unwatch();
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef SETTINGS_CLASS_H
+#define SETTINGS_CLASS_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <core/reactor.hpp>
+
+/**
+ * Struct holding an immutable snapshot of the configuration file.
+ *
+ * @var user user, the daemon runs as
+ * @var pidFile path to pid file
+ * @var workdir working directory, empty for the user's home directory
+ * @var encryptedWorkdir whether working directory is encrypted
+ * @var captureDelays whether macro recording captures delays
+ * @var controlSocket path to control socket, relative to working directory,
+ * empty if disabled
+ * @var logLevel minimum level of logged messages, e.g. "info"
+ * @var logFile path to log file, empty for stderr or syslog
+ * @var gracePeriod seconds, an unplugged device is kept for being replugged,
+ * 0 to release it immediately
+ * @var deviceKeys keys advertised by the virtual input device, keyed by
+ * "vendor:product", e.g. "046d:c24b"
+ */
+struct Settings {
+	std::string user;
+	std::string pidFile;
+	std::string workdir;
+	bool encryptedWorkdir;
+	bool captureDelays;
+	std::string controlSocket;
+	std::string logLevel;
+	std::string logFile;
+	int gracePeriod;
+	std::map<std::string, std::string> deviceKeys;
+};
+
+/**
+ * Class publishing the current settings.
+ *
+ * Readers get a shared snapshot, which stays valid as long as they hold it.
+ * When the configuration file changes, a new snapshot is built and swapped in
+ * atomically, so readers never see a partially updated configuration. Only
+ * captureDelays, logLevel and gracePeriod take effect at runtime and deviceKeys
+ * applies to devices connected afterwards, all other settings are applied once at
+ * startup.
+ */
+class SettingsStore {
+	public:
+		/**
+		 * Returns current settings. Can be called from any thread.
+		 */
+		std::shared_ptr<const Settings> get() const;
+
+		/**
+		 * Reads configuration file and publishes new settings. Missing
+		 * settings are replaced with their default values.
+		 * @return 0 on success, -1 if file can't be read or parsed
+		 */
+		int load();
+
+		/**
+		 * Reloads settings on the event loop, whenever the configuration
+		 * file has been written or replaced.
+		 * @return 0 on success, -1 on error
+		 */
+		int watch(Reactor *reactor);
+		void unwatch();
+		std::string getPath();
+		SettingsStore(std::string path);
+		~SettingsStore();
+
+	private:
+		std::string path_;
+		std::string directory_; /**< directory watched with inotify */
+		std::string name_; /**< file name within directory */
+		std::shared_ptr<const Settings> settings_;
+		int inotifyFd_;
+		Reactor *reactor_;
+		int parse(struct Settings *settings);
+		void receive();
+};
+
+#endif
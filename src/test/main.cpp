@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <core/logger.hpp>
+
+#include "test.hpp"
+
+int main(int argc, char *argv[]) {
+	if (argc > 2) {
+		std::cerr << "Usage: " << argv[0] << " [filter]" << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	std::string filter;
+
+	if (argc == 2) {
+		filter = argv[1];
+	}
+
+	// errors of simulated devices are expected, keep the output readable
+	Logger::get()->setLevel(LogLevel::Error);
+
+	Test test;
+	addDecodeTests(&test);
+	addDeviceManagerTests(&test);
+	addHidInterfaceTests(&test);
+	addLatencyTests(&test);
+	addMacroEngineTests(&test);
+	addRecordingTests(&test);
+
+	int nRun;
+	int nFailed = test.run(filter, &nRun);
+
+	if (!nRun) {
+		std::cerr << "No test matches " << filter << "." << std::endl;
+
+		return EXIT_FAILURE;
+	}
+
+	std::cout << nRun - nFailed << " of " << nRun << " tests passed." << std::endl;
+
+	return nFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include <core/logger.hpp>
+
+#include "test.hpp"
+
+/* constants */
+constexpr auto DAEMON_TIMEOUT =	5; /* seconds */
+
+int Test::nFailed_ = 0;
+
+void Test::add(std::string name, Function function) {
+	cases_.push_back(Case{name, function});
+}
+
+int Test::run(std::string filter, int *nRun) {
+	int nFailed = 0;
+	*nRun = 0;
+
+	for (auto &testCase : cases_) {
+		if (testCase.name.find(filter) == std::string::npos) {
+			continue;
+		}
+
+		nFailed_ = 0;
+		testCase.function();
+		std::printf("%-6s %s\n", nFailed_ ? "FAIL" : "ok", testCase.name.c_str());
+		std::fflush(stdout);
+
+		if (nFailed_) {
+			nFailed++;
+		}
+
+		(*nRun)++;
+	}
+
+	return nFailed;
+}
+
+void Test::check(bool condition, const char *expression, const char *file, int line) {
+	if (!condition) {
+		std::printf("%s:%d: check failed: %s\n", file, line, expression);
+		nFailed_++;
+	}
+}
+
+int Simulation::simulate(sidewinderd::DevNode *devNode, int *hidFd, int *inputFd) {
+	int hid[2], input[2] = {-1, -1};
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, hid)) {
+		return -1;
+	}
+
+	if (inputFd ? pipe2(input, O_CLOEXEC) : (input[1] = open("/dev/null", O_WRONLY | O_CLOEXEC)) < 0) {
+		close(hid[0]);
+		close(hid[1]);
+
+		return -1;
+	}
+
+	if (hidFd) {
+		*hidFd = hid[0];
+	} else {
+		close(hid[0]);
+	}
+
+	if (inputFd) {
+		*inputFd = input[0];
+	}
+
+	devNode->hidraw = "simulated";
+	devNode->sysPath = "simulated";
+	devNode->workdir = workdir_;
+	devNode->hidrawFd = hid[1];
+	devNode->uinputFd = input[1];
+
+	return 0;
+}
+
+Keyboard *Simulation::createKeyboard(sidewinderd::DevNode *devNode, const struct Device *device) {
+	// keyboards keep a copy of their device
+	struct Device copy = device ? *device : *DeviceManager::match("045e", "074b");
+
+	return DeviceManager::createKeyboard(&copy, devNode, &settingsStore_, &process_, &reactor, &blinkService_);
+}
+
+std::string Simulation::getWorkdir() {
+	return workdir_;
+}
+
+Process *Simulation::getProcess() {
+	return &process_;
+}
+
+Simulation::Simulation() : settingsStore_{"/dev/null"}, blinkService_{&reactor} {
+	isTemporary_ = mkdtemp(directory_) != nullptr;
+	TEST_CHECK(isTemporary_);
+	workdir_ = std::string(directory_) + "/";
+	settingsStore_.load();
+}
+
+Simulation::Simulation(std::string configPath, std::string workdir) :
+		settingsStore_{configPath}, blinkService_{&reactor} {
+	isTemporary_ = false;
+	workdir_ = workdir.empty() ? "" : workdir + "/";
+	settingsStore_.load();
+}
+
+Simulation::~Simulation() {
+	if (!isTemporary_) {
+		return;
+	}
+
+	for (int i = MIN_PROFILE; i < MAX_PROFILE; i++) {
+		std::stringstream profileFolderPath;
+		profileFolderPath << workdir_ << "profile_" << i + 1;
+		rmdir(profileFolderPath.str().c_str());
+	}
+
+	rmdir(directory_);
+}
+
+bool Daemon::isRunning() {
+	return monitor_.valid() && monitor_.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+int Daemon::wait() {
+	if (monitor_.wait_for(std::chrono::seconds(DAEMON_TIMEOUT)) != std::future_status::ready) {
+		std::printf("%s: event loop didn't stop, aborting\n", directory_);
+		std::fflush(stdout);
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	return monitor_.get();
+}
+
+Daemon::Daemon() {
+	TEST_CHECK(mkdtemp(directory_) != nullptr);
+	cwd_ = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	TEST_CHECK(chdir(directory_) == 0);
+
+	Logger::get()->stop();
+	Logger::get()->start();
+
+	sigemptyset(&signals_);
+	sigaddset(&signals_, SIGINT);
+	sigaddset(&signals_, SIGTERM);
+	sigaddset(&signals_, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &signals_, &mask_);
+
+	settingsStore_.load();
+	process_.setActive(true);
+	deviceManager_.reset(new DeviceManager(&settingsStore_, &process_));
+	monitor_ = std::async(std::launch::async, [this]() { return deviceManager_->monitor(); });
+}
+
+Daemon::~Daemon() {
+	if (isRunning()) {
+		kill(getpid(), SIGTERM);
+	}
+
+	if (monitor_.valid()) {
+		wait();
+	}
+
+	deviceManager_.reset();
+	Logger::get()->stop();
+
+	// discard signals, which haven't been received, before unblocking them
+	struct timespec timeout = timespec();
+	while (sigtimedwait(&signals_, nullptr, &timeout) > 0) {}
+	pthread_sigmask(SIG_SETMASK, &mask_, nullptr);
+
+	if (cwd_ >= 0) {
+		fchdir(cwd_);
+		close(cwd_);
+	}
+
+	rmdir(directory_);
+}
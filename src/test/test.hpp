@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#ifndef TEST_CLASS_H
+#define TEST_CLASS_H
+
+#include <csignal>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <device_data.hpp>
+#include <process.hpp>
+#include <settings.hpp>
+#include <core/blink_service.hpp>
+#include <core/device.hpp>
+#include <core/device_manager.hpp>
+#include <core/keyboard.hpp>
+#include <core/reactor.hpp>
+
+/*
+ * Checks a condition. A failed check is reported, the test keeps running, so
+ * all failures of a test show up at once.
+ */
+#define TEST_CHECK(condition) Test::check((condition), #condition, __FILE__, __LINE__)
+
+/**
+ * Class running unit tests.
+ *
+ * Tests run without hardware. Devices are simulated with socketpairs and
+ * pipes, like the replay tool does.
+ */
+class Test {
+	public:
+		typedef std::function<void()> Function;
+
+		/**
+		 * Registers test.
+		 * @param name unique name, e.g. "decode/sidewinder"
+		 * @param function test body, using TEST_CHECK()
+		 */
+		void add(std::string name, Function function);
+
+		/**
+		 * Runs all tests, whose name contains filter.
+		 * @param nRun set to number of tests run
+		 * @return number of failed tests
+		 */
+		int run(std::string filter, int *nRun);
+
+		/**
+		 * Records result of a check. Use TEST_CHECK() instead.
+		 */
+		static void check(bool condition, const char *expression, const char *file, int line);
+
+	private:
+		struct Case {
+			std::string name;
+			Function function;
+		};
+
+		std::vector<Case> cases_;
+		static int nFailed_; /**< failed checks of the running test */
+};
+
+/**
+ * Class simulating keyboards without any hardware, used by tests, benchmarks
+ * and the replay tool.
+ *
+ * A socketpair stands in for hidraw and keeps report boundaries, a pipe
+ * captures uinput output. All keyboards share settings, event loop and blink
+ * service, they need to be deleted before the simulation. Unless a workdir is
+ * given, profiles are kept in a temporary directory, which is removed with the
+ * simulation, if nothing else has been stored in it.
+ */
+class Simulation {
+	public:
+		Reactor reactor;
+
+		/**
+		 * Creates simulated nodes and injects them into devNode.
+		 * @param hidFd set to device side of hidraw, closed if nullptr
+		 * @param inputFd set to reading side of uinput, output is
+		 * discarded if nullptr
+		 * @return 0 on success, -1 on error
+		 */
+		int simulate(sidewinderd::DevNode *devNode, int *hidFd, int *inputFd);
+
+		/**
+		 * Creates keyboard on simulated nodes, it isn't connected yet.
+		 * Can be called from any thread.
+		 * @param device supported device, SideWinder X6 if nullptr
+		 * @return keyboard, which needs to be deleted by the caller
+		 */
+		Keyboard *createKeyboard(sidewinderd::DevNode *devNode, const struct Device *device = nullptr);
+
+		/**
+		 * Returns profile directory of all keyboards, ending with a slash.
+		 */
+		std::string getWorkdir();
+		Process *getProcess();
+
+		/**
+		 * Stores profiles in a temporary directory.
+		 */
+		Simulation();
+
+		/**
+		 * @param configPath configuration file
+		 * @param workdir directory containing profile_* directories, the
+		 * working directory if empty
+		 */
+		Simulation(std::string configPath, std::string workdir);
+		~Simulation();
+
+	private:
+		char directory_[32] = "/tmp/sidewinderd-test-XXXXXX";
+		bool isTemporary_;
+		std::string workdir_;
+		SettingsStore settingsStore_;
+		Process process_;
+		BlinkService blinkService_;
+};
+
+/**
+ * Class running the daemon's event loop with DeviceManager::monitor() on its
+ * own thread, in a temporary working directory.
+ *
+ * Like main(), the log drain thread is started first. Stop signals and SIGUSR1
+ * are blocked on the calling thread meanwhile, as they are on the daemon's
+ * main thread, so signals sent to the process reach the event loop, unless
+ * another thread has left them unblocked.
+ */
+class Daemon {
+	public:
+		/**
+		 * Checks, whether monitor() is still running.
+		 */
+		bool isRunning();
+
+		/**
+		 * Waits for monitor() to return, e.g. after a stop signal. If it
+		 * doesn't, the event loop can't be torn down anymore and all tests
+		 * are aborted.
+		 * @return result of monitor()
+		 */
+		int wait();
+		Daemon();
+		~Daemon();
+
+	private:
+		char directory_[32] = "/tmp/sidewinderd-test-XXXXXX";
+		int cwd_; /**< working directory of the tests */
+		sigset_t signals_; /**< signals received by the event loop */
+		sigset_t mask_; /**< previous signal mask of the calling thread */
+		SettingsStore settingsStore_{"/dev/null"};
+		Process process_;
+		std::unique_ptr<DeviceManager> deviceManager_;
+		std::future<int> monitor_;
+};
+
+/*
+ * test suites, one per component
+ */
+void addDecodeTests(Test *test);
+void addDeviceManagerTests(Test *test);
+void addHidInterfaceTests(Test *test);
+void addLatencyTests(Test *test);
+void addMacroEngineTests(Test *test);
+void addRecordingTests(Test *test);
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cstring>
+
+#include <core/keyboard.hpp>
+#include <vendor/logitech/g103.hpp>
+#include <vendor/logitech/g105.hpp>
+#include <vendor/logitech/g710.hpp>
+#include <vendor/microsoft/sidewinder.hpp>
+
+#include "test.hpp"
+
+/* constants */
+constexpr auto SW_MACRO_KEYS =		30;
+constexpr auto LOGITECH_MACRO_KEYS =	6;
+
+typedef std::size_t (*Decoder)(const unsigned char *buf, ssize_t nBytes, struct KeyState *state, struct KeyData *keys);
+
+/*
+ * Presses and releases a single key, which is reported as one bit of the
+ * report, and checks both edges.
+ */
+static void checkKey(Decoder decode, const unsigned char *report, ssize_t nBytes, std::size_t byte, int bit, int index, KeyData::KeyType type) {
+	unsigned char buf[MAX_BUF];
+	struct KeyState state = KeyState();
+	struct KeyData keys[MAX_KEY_EVENTS];
+
+	std::memcpy(buf, report, nBytes);
+	buf[byte] |= 1 << bit;
+	TEST_CHECK(decode(buf, nBytes, &state, keys) == 1);
+	TEST_CHECK(keys[0].index == index && keys[0].isPressed && keys[0].type == type);
+
+	// holding the key down doesn't repeat it
+	TEST_CHECK(decode(buf, nBytes, &state, keys) == 0);
+
+	TEST_CHECK(decode(report, nBytes, &state, keys) == 1);
+	TEST_CHECK(keys[0].index == index && !keys[0].isPressed && keys[0].type == type);
+}
+
+void addDecodeTests(Test *test) {
+	test->add("decode/edges", []() {
+		struct KeyData keys[MAX_KEY_EVENTS];
+
+		// S1 released, S2 pressed, S3 held down
+		TEST_CHECK(Keyboard::getEdges(0x5, 0x6, KeyData::KeyType::Macro, keys) == 2);
+		TEST_CHECK(keys[0].index == 1 && !keys[0].isPressed);
+		TEST_CHECK(keys[1].index == 2 && keys[1].isPressed);
+
+		TEST_CHECK(Keyboard::getEdges(0x6, 0x6, KeyData::KeyType::Macro, keys) == 0);
+
+		// all 32 bits change at once
+		TEST_CHECK(Keyboard::getEdges(0, 0xffffffff, KeyData::KeyType::Extra, keys) == 32);
+		TEST_CHECK(keys[31].index == 32 && keys[31].isPressed && keys[31].type == KeyData::KeyType::Extra);
+	});
+
+	test->add("decode/sidewinder/macro", []() {
+		const unsigned char report[] = {0x08, 0x00, 0x00, 0x00, 0x00};
+
+		for (int i = 0; i < SW_MACRO_KEYS; i++) {
+			checkKey(&SideWinder::decode, report, sizeof(report), 1 + i / 8, i % 8, i + 1, KeyData::KeyType::Macro);
+		}
+	});
+
+	test->add("decode/sidewinder/all", []() {
+		const unsigned char pressed[] = {0x08, 0xff, 0xff, 0xff, 0x3f};
+		const unsigned char released[] = {0x08, 0x00, 0x00, 0x00, 0x00};
+		struct KeyState state = KeyState();
+		struct KeyData keys[MAX_KEY_EVENTS];
+
+		TEST_CHECK(SideWinder::decode(pressed, sizeof(pressed), &state, keys) == SW_MACRO_KEYS);
+		TEST_CHECK(SideWinder::decode(released, sizeof(released), &state, keys) == SW_MACRO_KEYS);
+	});
+
+	test->add("decode/sidewinder/stray", []() {
+		// bits 6 and 7 of the last byte don't belong to any key
+		const unsigned char report[] = {0x08, 0x00, 0x00, 0x00, 0xc0};
+		struct KeyState state = KeyState();
+		struct KeyData keys[MAX_KEY_EVENTS];
+
+		TEST_CHECK(SideWinder::decode(report, sizeof(report), &state, keys) == 0);
+	});
+
+	test->add("decode/sidewinder/extra", []() {
+		const unsigned char record[] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x11, 0x00};
+		const unsigned char profile[] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x14, 0x00};
+		const unsigned char released[] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+		struct KeyState state = KeyState();
+		struct KeyData keys[MAX_KEY_EVENTS];
+
+		TEST_CHECK(SideWinder::decode(record, sizeof(record), &state, keys) == 1);
+		TEST_CHECK(keys[0].index == 0x11 && keys[0].isPressed && keys[0].type == KeyData::KeyType::Extra);
+
+		// media keys are reported one at a time, so switching releases the previous one
+		TEST_CHECK(SideWinder::decode(profile, sizeof(profile), &state, keys) == 2);
+		TEST_CHECK(keys[0].index == 0x11 && !keys[0].isPressed);
+		TEST_CHECK(keys[1].index == 0x14 && keys[1].isPressed);
+
+		TEST_CHECK(SideWinder::decode(released, sizeof(released), &state, keys) == 1);
+		TEST_CHECK(keys[0].index == 0x14 && !keys[0].isPressed);
+	});
+
+	test->add("decode/sidewinder/invalid", []() {
+		const unsigned char report[] = {0x08, 0xff, 0xff, 0xff, 0xff};
+		struct KeyState state = KeyState();
+		struct KeyData keys[MAX_KEY_EVENTS];
+
+		// wrong size, wrong report ID and failed reads
+		TEST_CHECK(SideWinder::decode(report, 4, &state, keys) == 0);
+		TEST_CHECK(SideWinder::decode(report + 1, 5, &state, keys) == 0);
+		TEST_CHECK(SideWinder::decode(report, -1, &state, keys) == 0);
+	});
+
+	test->add("decode/g103", []() {
+		const unsigned char report[] = {0x03, 0x00, 0x00};
+
+		for (int i = 0; i < LOGITECH_MACRO_KEYS; i++) {
+			checkKey(&LogitechG103::decode, report, sizeof(report), 1, i, i + 1, KeyData::KeyType::Macro);
+		}
+	});
+
+	test->add("decode/g105", []() {
+		const unsigned char report[] = {0x03, 0x00, 0x00};
+
+		for (int i = 0; i < LOGITECH_MACRO_KEYS; i++) {
+			checkKey(&LogitechG105::decode, report, sizeof(report), 1, i, i + 1, KeyData::KeyType::Macro);
+		}
+
+		// M1 - M3 and MR
+		for (int i = 0; i < 4; i++) {
+			checkKey(&LogitechG105::decode, report, sizeof(report), 2, i, i + 1, KeyData::KeyType::Extra);
+		}
+	});
+
+	test->add("decode/g710", []() {
+		const unsigned char report[] = {0x03, 0x00, 0x00, 0x00};
+
+		for (int i = 0; i < LOGITECH_MACRO_KEYS; i++) {
+			checkKey(&LogitechG710::decode, report, sizeof(report), 1, i, i + 1, KeyData::KeyType::Macro);
+		}
+
+		// M1 - M3 and MR live in the upper nibble
+		for (int i = 0; i < 4; i++) {
+			checkKey(&LogitechG710::decode, report, sizeof(report), 2, i + 4, i + 1, KeyData::KeyType::Extra);
+		}
+	});
+}
@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pwd.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#include <core/keyboard.hpp>
+
+#include "test.hpp"
+
+/* constants */
+constexpr auto PARALLEL_DEVICES =	4;
+constexpr auto PARALLEL_TIMEOUT =	5; /* seconds */
+constexpr auto PRIVILEGED_TIME =	50; /* us */
+constexpr auto SIGNAL_TIMEOUT =		5000; /* ms */
+constexpr auto UNPRIVILEGED_USER =	"nobody";
+
+/*
+ * Sets up several keyboards at once from an event loop callback, like
+ * DeviceManager::bind() does on hotplug. The event loop is locked meanwhile,
+ * so creating a keyboard must not touch it. Run as root, the daemon switches
+ * to an unprivileged user and other devices keep switching back to root for
+ * opening their nodes, which profile directories mustn't be created with.
+ */
+static void testParallelCreate() {
+	Simulation simulation;
+	auto process = simulation.getProcess();
+	std::atomic<bool> isCreated{false};
+	std::thread sibling;
+	auto user = getpwnam(UNPRIVILEGED_USER);
+	auto uid = geteuid();
+
+	if (!uid && user) {
+		TEST_CHECK(chown(simulation.getWorkdir().c_str(), user->pw_uid, user->pw_gid) == 0);
+		TEST_CHECK(process->applyUser(UNPRIVILEGED_USER) == 0);
+		// the sibling switches the effective user of the whole process
+		uid = geteuid();
+		sibling = std::thread([&]() {
+			while (!isCreated) {
+				process->privilege();
+				usleep(PRIVILEGED_TIME);
+				process->unprivilege();
+			}
+		});
+	}
+
+	auto &reactor = simulation.reactor;
+	std::vector<sidewinderd::DevNode> devNodes(PARALLEL_DEVICES);
+	std::vector<int> peers;
+
+	for (auto &devNode : devNodes) {
+		int hidFd;
+		TEST_CHECK(simulation.simulate(&devNode, &hidFd, nullptr) == 0);
+		peers.push_back(hidFd);
+	}
+
+	std::vector<std::unique_ptr<Keyboard>> keyboards;
+	std::promise<void> done;
+	int hotplug = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	reactor.add(hotplug, EPOLLIN, [&](uint32_t) {
+		uint64_t value;
+		read(hotplug, &value, sizeof(value));
+		std::vector<std::future<Keyboard *>> futures;
+
+		for (auto &devNode : devNodes) {
+			futures.push_back(std::async(std::launch::async, [&]() {
+				return simulation.createKeyboard(&devNode);
+			}));
+		}
+
+		for (auto &future : futures) {
+			keyboards.emplace_back(future.get());
+			keyboards.back()->connect();
+		}
+
+		isCreated = true;
+
+		done.set_value();
+	});
+
+	std::thread loop([&reactor]() { reactor.run(); });
+	uint64_t value = 1;
+	write(hotplug, &value, sizeof(value));
+	auto status = done.get_future().wait_for(std::chrono::seconds(PARALLEL_TIMEOUT));
+	TEST_CHECK(status == std::future_status::ready);
+
+	if (status != std::future_status::ready) {
+		// the event loop is stuck, it can't be torn down anymore
+		std::printf("FAIL   device/parallel_create\n");
+		std::fflush(stdout);
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	reactor.stop();
+	loop.join();
+	TEST_CHECK(keyboards.size() == PARALLEL_DEVICES);
+
+	for (int i = MIN_PROFILE; i < MAX_PROFILE; i++) {
+		std::stringstream profileFolderPath;
+		profileFolderPath << simulation.getWorkdir() << "profile_" << i + 1;
+		struct stat status;
+		TEST_CHECK(stat(profileFolderPath.str().c_str(), &status) == 0 && status.st_uid == uid);
+	}
+
+	if (sibling.joinable()) {
+		sibling.join();
+		seteuid(0);
+		setegid(0);
+	}
+
+	keyboards.clear();
+	reactor.remove(hotplug);
+	close(hotplug);
+
+	for (auto peer : peers) {
+		close(peer);
+	}
+}
+
+/*
+ * SIGUSR1 dumps latency statistics and SIGTERM stops the daemon, both received
+ * through the event loop, while the log drain thread is running. A thread not
+ * blocking them would either be killed by SIGUSR1 or swallow SIGTERM.
+ */
+static void testSignals() {
+	Daemon daemon;
+	sigset_t pending;
+
+	TEST_CHECK(kill(getpid(), SIGUSR1) == 0);
+
+	for (int i = 0; i < SIGNAL_TIMEOUT; i++) {
+		sigpending(&pending);
+
+		if (!sigismember(&pending, SIGUSR1)) {
+			break;
+		}
+
+		usleep(1000);
+	}
+
+	TEST_CHECK(!sigismember(&pending, SIGUSR1));
+	TEST_CHECK(daemon.isRunning());
+
+	TEST_CHECK(kill(getpid(), SIGTERM) == 0);
+	TEST_CHECK(daemon.wait() == 0);
+}
+
+void addDeviceManagerTests(Test *test) {
+	test->add("device/parallel_create", testParallelCreate);
+	test->add("device/signals", testSignals);
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include <core/hid_interface.hpp>
+#include <core/reactor.hpp>
+
+#include "test.hpp"
+
+/*
+ * A write replacing a queued write to the same report ID keeps its position,
+ * so writes to other report IDs aren't reordered. Writes to a socket fail, but
+ * their results are still delivered in order.
+ */
+static void testMerge() {
+	int hid[2];
+	TEST_CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, hid) == 0);
+	Reactor reactor;
+	std::vector<std::string> results;
+	auto result = [&](std::string name) {
+		return [&, name](int) {
+			results.push_back(name);
+
+			if (results.size() == 2) {
+				reactor.stop();
+			}
+		};
+	};
+
+	HidInterface hidInterface(&hid[1], &reactor);
+	TEST_CHECK(hidInterface.watch() == 0);
+
+	// keep writes queued, until all of them have been submitted
+	hidInterface.stop();
+	hidInterface.setReport(0x07, 0x01, result("led"));
+	hidInterface.setReport(0x08, 0x01, result("macro"));
+	hidInterface.setReport(0x07, 0x02, result("led replaced"));
+	hidInterface.start();
+	reactor.run();
+
+	TEST_CHECK(results.size() == 2);
+	TEST_CHECK(results.size() == 2 && results[0] == "led replaced" && results[1] == "macro");
+
+	hidInterface.stop();
+	close(hid[0]);
+	close(hid[1]);
+}
+
+void addHidInterfaceTests(Test *test) {
+	test->add("hid/merge", testMerge);
+}
@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <core/macro.hpp>
+#include <core/macro_scheduler.hpp>
+
+#include "test.hpp"
+
+/* constants */
+constexpr auto IDLE_SETTLE =		100; /* ms */
+constexpr auto IDLE_DURATION =		500; /* ms */
+constexpr auto LATENCY_PRESSES =	200;
+constexpr auto MAX_MEDIAN_LATENCY =	10000000LL; /* ns */
+constexpr auto MAX_SHUTDOWN =		100000000LL; /* ns */
+
+static const unsigned char REPORT_S1[] =	{0x08, 0x01, 0x00, 0x00, 0x00};
+static const unsigned char REPORT_MACRO_UP[] =	{0x08, 0x00, 0x00, 0x00, 0x00};
+
+/*
+ * SideWinder connected to an event loop on its own thread. Reports are
+ * written to the hidraw socketpair, the virtual input device is a pipe. S1
+ * plays a macro, which taps a single key.
+ */
+class SimulatedKeyboard {
+	public:
+		int hidFd; /**< device side of hidraw */
+		int inputFd; /**< reading side of virtual input */
+		pid_t loopTid; /**< thread running the event loop */
+
+		SimulatedKeyboard() {
+			macroPath_ = Macro::getBinaryPath(simulation_.getWorkdir() + "profile_1/s1.xml");
+			TEST_CHECK(mkdir((simulation_.getWorkdir() + "profile_1").c_str(), S_IRWXU) == 0);
+			Macro macro;
+			macro.push_back(MacroEvent{EV_KEY, KEY_A, 1, 0});
+			macro.push_back(MacroEvent{EV_KEY, KEY_A, 0, 0});
+			TEST_CHECK(macro.saveBinary(macroPath_) == 0);
+
+			sidewinderd::DevNode devNode;
+			TEST_CHECK(simulation_.simulate(&devNode, &hidFd, &inputFd) == 0);
+			keyboard_.reset(simulation_.createKeyboard(&devNode));
+			keyboard_->connect();
+
+			loopTid = 0;
+			loop_ = std::thread([this]() {
+				loopTid = syscall(SYS_gettid);
+				simulation_.reactor.run();
+			});
+		}
+
+		~SimulatedKeyboard() {
+			simulation_.reactor.stop();
+			loop_.join();
+			keyboard_.reset();
+			close(hidFd);
+			close(inputFd);
+			unlink(macroPath_.c_str());
+		}
+
+	private:
+		Simulation simulation_;
+		std::string macroPath_;
+		std::unique_ptr<Keyboard> keyboard_;
+		std::thread loop_;
+};
+
+/*
+ * Returns number of times a thread has blocked, e.g. in epoll_wait().
+ */
+static long long getWaits(pid_t tid) {
+	std::ifstream status("/proc/self/task/" + std::to_string(tid) + "/status");
+	std::string line;
+
+	while (std::getline(status, line)) {
+		if (!line.compare(0, 24, "voluntary_ctxt_switches:")) {
+			return std::stoll(line.substr(24));
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * An idle keyboard doesn't wake up the event loop, there is no timeout.
+ */
+static void testIdle() {
+	SimulatedKeyboard keyboard;
+
+	// let results of the initial LED writes arrive
+	usleep(IDLE_SETTLE * 1000);
+	auto before = getWaits(keyboard.loopTid);
+	usleep(IDLE_DURATION * 1000);
+	auto wakeups = getWaits(keyboard.loopTid) - before;
+	std::printf("       %lld wakeups in %d ms idle\n", wakeups, IDLE_DURATION);
+
+	TEST_CHECK(before >= 0);
+	TEST_CHECK(wakeups == 0);
+}
+
+/*
+ * Time from writing the report of a macro key to reading the first event of
+ * its macro from the virtual input device.
+ */
+static void testLatency() {
+	SimulatedKeyboard keyboard;
+	std::vector<long long> latencies;
+
+	for (int i = 0; i < LATENCY_PRESSES; i++) {
+		auto start = MacroScheduler::now();
+		TEST_CHECK(write(keyboard.hidFd, REPORT_S1, sizeof(REPORT_S1)) == sizeof(REPORT_S1));
+		struct input_event event;
+		TEST_CHECK(read(keyboard.inputFd, &event, sizeof(event)) == sizeof(event));
+		latencies.push_back(MacroScheduler::now() - start);
+		TEST_CHECK(event.type == EV_KEY && event.code == KEY_A && event.value == 1);
+
+		// each event of the macro is followed by EV_SYN, the key release ends it
+		while (!(event.type == EV_KEY && !event.value) && read(keyboard.inputFd, &event, sizeof(event)) == sizeof(event));
+		TEST_CHECK(read(keyboard.inputFd, &event, sizeof(event)) == sizeof(event) && event.type == EV_SYN);
+
+		TEST_CHECK(write(keyboard.hidFd, REPORT_MACRO_UP, sizeof(REPORT_MACRO_UP)) == sizeof(REPORT_MACRO_UP));
+	}
+
+	TEST_CHECK(latencies.size() == LATENCY_PRESSES);
+
+	if (latencies.empty()) {
+		return;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	auto median = latencies[latencies.size() / 2];
+	std::printf("       key to event latency: median %lld us, max %lld us\n",
+			median / 1000, latencies.back() / 1000);
+
+	TEST_CHECK(median < MAX_MEDIAN_LATENCY);
+}
+
+/*
+ * SIGTERM stops the daemon's event loop right away instead of on a timeout.
+ */
+static void testShutdown() {
+	Daemon daemon;
+	usleep(IDLE_SETTLE * 1000);
+	auto start = MacroScheduler::now();
+	kill(getpid(), SIGTERM);
+	auto status = daemon.wait();
+	auto elapsed = MacroScheduler::now() - start;
+	std::printf("       shutdown in %lld us\n", elapsed / 1000);
+
+	TEST_CHECK(status == 0);
+	TEST_CHECK(elapsed < MAX_SHUTDOWN);
+}
+
+void addLatencyTests(Test *test) {
+	test->add("loop/idle", testIdle);
+	test->add("loop/latency", testLatency);
+	test->add("loop/shutdown", testShutdown);
+}
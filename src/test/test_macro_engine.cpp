@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <core/latency_stats.hpp>
+#include <core/logger.hpp>
+#include <core/macro.hpp>
+#include <core/macro_cache.hpp>
+#include <core/macro_engine.hpp>
+#include <core/reactor.hpp>
+#include <core/virtual_input.hpp>
+
+#include "test.hpp"
+
+/* constants */
+constexpr auto STRESS_THREADS =		4;
+constexpr auto STRESS_ROUNDS =		8;
+constexpr auto STRESS_PLAYS =		MAX_PLAYBACKS * 8; /* per round */
+constexpr auto STRESS_KEYS =		10;
+constexpr auto STRESS_DELAY =		5; /* ms, playbacks mustn't finish while spamming */
+constexpr auto MAX_RSS_GROWTH =		1024; /* kB */
+constexpr auto SHUTDOWN_KEYS =		100;
+constexpr auto SHUTDOWN_DELAY =		10; /* ms */
+constexpr auto STRESS_TIMEOUT =		5000; /* ms */
+
+/*
+ * Returns a field of /proc/self/status, e.g. "Threads:" or "VmRSS:" in kB.
+ */
+static std::size_t getStatus(const std::string &field) {
+	std::ifstream status("/proc/self/status");
+	std::string line;
+
+	while (std::getline(status, line)) {
+		if (!line.compare(0, field.size(), field)) {
+			return std::stoul(line.substr(field.size()));
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Returns number of threads of this process.
+ */
+static std::size_t getThreads() {
+	return getStatus("Threads:");
+}
+
+/*
+ * Returns number of open file descriptors of this process.
+ */
+static std::size_t getFds() {
+	std::size_t nFds = 0;
+	DIR *dir = opendir("/proc/self/fd");
+
+	while (dir && readdir(dir)) {
+		nFds++;
+	}
+
+	if (dir) {
+		closedir(dir);
+	}
+
+	return nFds;
+}
+
+/*
+ * Presses and releases keys, waiting before every event.
+ */
+static std::shared_ptr<const Macro> createMacro(int nKeys, uint32_t delay) {
+	auto macro = std::make_shared<Macro>();
+
+	for (int i = 0; i < nKeys; i++) {
+		macro->push_back(MacroEvent{EV_KEY, static_cast<uint16_t>(KEY_A + i % 26), 1, delay});
+		macro->push_back(MacroEvent{EV_KEY, static_cast<uint16_t>(KEY_A + i % 26), 0, delay});
+	}
+
+	return macro;
+}
+
+/*
+ * Macro engine running on its own event loop. Sent key events are counted
+ * on a reader thread, which stops, once the virtual input device is closed.
+ */
+class EngineFixture {
+	public:
+		Reactor reactor;
+		MacroCache cache{1};
+		LatencyStats stats;
+		VirtualInput *virtInput;
+		MacroEngine *engine;
+		std::atomic<std::size_t> nEvents{0};
+
+		EngineFixture() {
+			int fds[2];
+			TEST_CHECK(pipe2(fds, O_CLOEXEC) == 0);
+			readFd_ = fds[0];
+			virtInput = new VirtualInput(fds[1]);
+			engine = new MacroEngine(&reactor, virtInput, &cache, &stats);
+			TEST_CHECK(engine->watch() == 0);
+			reader_ = std::thread([this]() {
+				struct input_event events[64];
+				ssize_t nBytes;
+
+				while ((nBytes = read(readFd_, events, sizeof(events))) > 0) {
+					for (std::size_t i = 0; i < nBytes / sizeof(struct input_event); i++) {
+						nEvents += events[i].type == EV_KEY;
+					}
+				}
+			});
+			loop_ = std::thread([this]() { reactor.run(); });
+		}
+
+		/*
+		 * Waits until the event loop has finished the callback it is
+		 * running, e.g. a playback sending its last event.
+		 */
+		void sync() {
+			int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			std::promise<void> done;
+			reactor.add(fd, EPOLLIN, [fd, &done](uint32_t) {
+				uint64_t value;
+				read(fd, &value, sizeof(value));
+				done.set_value();
+			});
+			uint64_t value = 1;
+			write(fd, &value, sizeof(value));
+			TEST_CHECK(done.get_future().wait_for(std::chrono::milliseconds(STRESS_TIMEOUT)) == std::future_status::ready);
+			reactor.remove(fd);
+			close(fd);
+		}
+
+		void stopLoop() {
+			reactor.stop();
+			loop_.join();
+		}
+
+		/*
+		 * Destroys the engine, regardless of running macros.
+		 */
+		void stop() {
+			if (loop_.joinable()) {
+				stopLoop();
+			}
+
+			delete engine;
+			delete virtInput;
+			reader_.join();
+			close(readFd_);
+		}
+
+	private:
+		int readFd_;
+		std::thread reader_;
+		std::thread loop_;
+};
+
+/*
+ * Plays far more macros at once from several threads than allowed, in several
+ * rounds. Only MAX_PLAYBACKS are played per round, all of them on the event
+ * loop, the rest is dropped. Neither threads nor memory pile up.
+ */
+static void testStress() {
+	EngineFixture fixture;
+	auto macro = createMacro(STRESS_KEYS, STRESS_DELAY);
+	auto nThreads = getThreads();
+	std::size_t rss = 0;
+	std::size_t nExpected = 0;
+
+	// dropped macros are expected
+	Logger::get()->setLevel(LogLevel::Error);
+
+	for (int round = 0; round < STRESS_ROUNDS; round++) {
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < STRESS_THREADS; i++) {
+			threads.push_back(std::thread([&fixture, macro]() {
+				for (std::size_t j = 0; j < STRESS_PLAYS / STRESS_THREADS; j++) {
+					fixture.engine->play(macro, 0);
+				}
+			}));
+		}
+
+		for (auto &thread : threads) {
+			thread.join();
+		}
+
+		nExpected += MAX_PLAYBACKS * macro->size();
+
+		for (int i = 0; i < STRESS_TIMEOUT && fixture.nEvents < nExpected; i++) {
+			usleep(1000);
+		}
+
+		// dropped macros would show up late, finished ones need to be released
+		usleep(STRESS_DELAY * 1000);
+		fixture.sync();
+		TEST_CHECK(fixture.nEvents == nExpected);
+		TEST_CHECK(getThreads() == nThreads);
+
+		// the first round allocates playbacks and log records
+		if (!round) {
+			rss = getStatus("VmRSS:");
+		}
+
+		TEST_CHECK(getStatus("VmRSS:") <= rss + MAX_RSS_GROWTH);
+	}
+
+	std::printf("       %zu of %zu macros played, VmRSS %zu kB\n", nExpected / macro->size(),
+			STRESS_PLAYS * STRESS_ROUNDS, getStatus("VmRSS:"));
+
+	TEST_CHECK(rss > 0);
+	fixture.stop();
+}
+
+/*
+ * Stops the event loop, while macros are waiting for their timerfd deadline
+ * and newly played macros are still waiting for the eventfd. Tearing down
+ * the engine mustn't leak file descriptors.
+ */
+static void testShutdown() {
+	auto nFds = getFds();
+
+	{
+		EngineFixture fixture;
+		auto macro = createMacro(SHUTDOWN_KEYS, SHUTDOWN_DELAY);
+
+		for (std::size_t i = 0; i < MAX_PLAYBACKS / 2; i++) {
+			fixture.engine->play(macro, 0);
+		}
+
+		usleep(SHUTDOWN_DELAY * 3 * 1000);
+		fixture.stopLoop();
+
+		// played after the event loop has stopped, never started
+		for (std::size_t i = 0; i < MAX_PLAYBACKS / 2; i++) {
+			fixture.engine->play(macro, 0);
+		}
+
+		fixture.stop();
+		TEST_CHECK(fixture.nEvents > 0);
+		TEST_CHECK(fixture.nEvents < MAX_PLAYBACKS / 2 * macro->size());
+	}
+
+	TEST_CHECK(getFds() == nFds);
+}
+
+void addMacroEngineTests(Test *test) {
+	test->add("macro/stress", testStress);
+	test->add("macro/shutdown", testShutdown);
+}
@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <core/macro.hpp>
+
+#include "test.hpp"
+
+/* constants */
+constexpr auto RECORD_EVENTS =		1000;
+constexpr auto RECORD_INTERVAL =	1000000; /* 1000 events per second */
+constexpr auto RECORD_TIMEOUT =		5000; /* ms */
+
+static const unsigned char REPORT_RECORD[] =	{0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x11, 0x00};
+static const unsigned char REPORT_EXTRA_UP[] =	{0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+static const unsigned char REPORT_S1[] =	{0x08, 0x01, 0x00, 0x00, 0x00};
+static const unsigned char REPORT_MACRO_UP[] =	{0x08, 0x00, 0x00, 0x00, 0x00};
+
+/*
+ * Event i of the recorded stream. Keys are pressed and released in turn, each
+ * pair using another key code, so dropped or reordered events show up.
+ */
+static struct input_event getEvent(int i, const struct timeval &start) {
+	struct input_event inev = input_event();
+	long long usec = start.tv_usec + i * 1000LL;
+	inev.time.tv_sec = start.tv_sec + usec / 1000000;
+	inev.time.tv_usec = usec % 1000000;
+	inev.type = EV_KEY;
+	inev.code = KEY_ESC + (i / 2) % 100;
+	inev.value = !(i % 2);
+
+	return inev;
+}
+
+/*
+ * Retries an operation every millisecond, until it succeeds or times out.
+ */
+template<typename Function>
+static bool waitFor(Function function) {
+	for (int i = 0; i < RECORD_TIMEOUT; i++) {
+		if (function()) {
+			return true;
+		}
+
+		usleep(1000);
+	}
+
+	return false;
+}
+
+/*
+ * Records from a FIFO standing in for /dev/input/event*, while the keyboard is
+ * driven through a simulated hidraw node, like the replay tool does. Writing
+ * to the FIFO keeps the test independent of /dev/uinput and root.
+ */
+static void testLoopback() {
+	Simulation simulation;
+	std::string workdir = simulation.getWorkdir();
+	std::string fifo = workdir + "event";
+	TEST_CHECK(mkdir((workdir + "profile_1").c_str(), S_IRWXU) == 0);
+	TEST_CHECK(mkfifo(fifo.c_str(), S_IRUSR | S_IWUSR) == 0);
+
+	int hidFd;
+	sidewinderd::DevNode devNode;
+	TEST_CHECK(simulation.simulate(&devNode, &hidFd, nullptr) == 0);
+	devNode.inputEvent = fifo;
+
+	std::unique_ptr<Keyboard> keyboard(simulation.createKeyboard(&devNode));
+	keyboard->connect();
+	std::thread loop([&simulation]() { simulation.reactor.run(); });
+
+	// arm recording and pick S1
+	write(hidFd, REPORT_RECORD, sizeof(REPORT_RECORD));
+	write(hidFd, REPORT_EXTRA_UP, sizeof(REPORT_EXTRA_UP));
+	write(hidFd, REPORT_S1, sizeof(REPORT_S1));
+	write(hidFd, REPORT_MACRO_UP, sizeof(REPORT_MACRO_UP));
+
+	// opening the writing side only succeeds, once recording has started
+	int evfd = -1;
+	TEST_CHECK(waitFor([&]() {
+		evfd = open(fifo.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+		return evfd >= 0 || errno != ENXIO;
+	}));
+	TEST_CHECK(evfd >= 0);
+
+	struct timeval start;
+	gettimeofday(&start, nullptr);
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	for (int i = 0; i < RECORD_EVENTS && evfd >= 0; i++) {
+		// the kernel follows each key event with EV_SYN, which is skipped
+		struct input_event inev[2] = {getEvent(i, start), input_event()};
+		inev[1].time = inev[0].time;
+		inev[1].type = EV_SYN;
+		inev[1].code = SYN_REPORT;
+		TEST_CHECK(write(evfd, inev, sizeof(inev)) == sizeof(inev));
+
+		next.tv_nsec += RECORD_INTERVAL;
+
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
+		}
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+	}
+
+	// stop recording only after the keyboard has read everything
+	TEST_CHECK(waitFor([&]() {
+		int nBytes = 0;
+
+		return ioctl(evfd, FIONREAD, &nBytes) == 0 && nBytes == 0;
+	}));
+	write(hidFd, REPORT_RECORD, sizeof(REPORT_RECORD));
+	write(hidFd, REPORT_EXTRA_UP, sizeof(REPORT_EXTRA_UP));
+
+	std::string path = workdir + "profile_1/s1.xml";
+	TEST_CHECK(waitFor([&]() {
+		return access(path.c_str(), F_OK) == 0;
+	}));
+
+	// the macro has been saved completely, once the loop is done dispatching
+	simulation.reactor.stop();
+	loop.join();
+
+	Macro macro;
+	TEST_CHECK(macro.loadXml(path) == 0);
+	TEST_CHECK(macro.size() == RECORD_EVENTS);
+
+	for (std::size_t i = 0; i < macro.size() && i < RECORD_EVENTS; i++) {
+		auto inev = getEvent(i, start);
+		TEST_CHECK(macro[i].type == EV_KEY && macro[i].code == inev.code && macro[i].value == inev.value);
+		TEST_CHECK(macro[i].delay == (i ? 1u : 0u));
+	}
+
+	keyboard.reset();
+	close(hidFd);
+	close(evfd);
+	unlink(path.c_str());
+	unlink(fifo.c_str());
+}
+
+void addRecordingTests(Test *test) {
+	test->add("recording/loopback", testLoopback);
+}
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+#include <iostream>
+#include <string>
+
+#include <getopt.h>
+
+#include <core/macro.hpp>
+
+void help(std::string name) {
+	std::cerr << "Usage: " << name << " [options] <input> <output>" << std::endl
+		  << std::endl
+		  << "Converts macro files between XML and binary format. The format" << std::endl
+		  << "is derived from the file extension, binary files use \".bin\"." << std::endl
+		  << std::endl
+		  << "Options:" << std::endl
+		  << "  -h, --help            Print this screen" << std::endl;
+}
+
+bool isBinary(std::string path) {
+	auto pos = path.rfind(".bin");
+
+	return pos != std::string::npos && pos + 4 == path.size();
+}
+
+int main(int argc, char *argv[]) {
+	static struct option longOptions[] = {
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	int opt, index = 0;
+
+	while ((opt = getopt_long(argc, argv, "h", longOptions, &index)) != -1) {
+		switch (opt) {
+			case 'h':
+				help(argv[0]);
+				return EXIT_SUCCESS;
+			default:
+				help(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != 2) {
+		help(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::string input = argv[optind];
+	std::string output = argv[optind + 1];
+	Macro macro;
+
+	if (isBinary(input) ? macro.loadBinary(input) : macro.loadXml(input)) {
+		std::cerr << "Error reading " << input << "." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (isBinary(output) ? macro.saveBinary(output) : macro.saveXml(output)) {
+		std::cerr << "Error writing " << output << "." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::clog << "Converted " << macro.size() << " events." << std::endl;
+
+	return EXIT_SUCCESS;
+}
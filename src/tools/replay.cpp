@@ -0,0 +1,419 @@
+/**
+ * Copyright (c) 2014 - 2016 Tolga Cakir <tolga@cevel.net>
+ *
+ * This source file is part of Sidewinder daemon and is distributed under the
+ * MIT License. For more information, see LICENSE file.
+ */
+
+/*
+ * Records hidraw reports into trace files and replays them through a real
+ * keyboard driver without any hardware. Trace files are plain text, one
+ * report per line, starting with the time in microseconds since the first
+ * report, followed by the report bytes in hex. Lines starting with '#' are
+ * ignored:
+ *
+ * # sidewinderd trace 1
+ * 0 08 01 00 00 00
+ * 85000 08 00 00 00 00
+ *
+ * During replay, a socketpair stands in for hidraw and a pipe captures the
+ * uinput output. Every captured key event is printed with the time since
+ * replay start, followed by a summary including the latency from writing a
+ * report to receiving the first frame it caused and the driver's own latency
+ * histograms.
+ */
+
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include <device_data.hpp>
+#include <core/device_manager.hpp>
+#include <core/macro_scheduler.hpp>
+#include <core/reactor.hpp>
+
+#include <test/test.hpp>
+
+/* constants */
+constexpr auto MAX_REPORT_SIZE =	64;
+constexpr auto IDLE_TIMEOUT =		NSEC_PER_SEC;
+constexpr auto SINK_BUFFER_SIZE =	1024 * 1024;
+constexpr auto SINK_READ_EVENTS =	64;
+
+/**
+ * Struct for storing a single recorded report.
+ *
+ * @var time time in microseconds since the first report
+ * @var data report bytes
+ */
+struct Report {
+	long long time;
+	std::vector<unsigned char> data;
+};
+
+/**
+ * Struct collecting replay state and statistics.
+ */
+struct Replay {
+	std::vector<Report> reports;
+	std::size_t next; /**< index of next report to be sent */
+	bool isFast; /**< ignore timestamps */
+	int hidFd; /**< our end of the simulated hidraw */
+	int sinkFd; /**< our end of the simulated uinput */
+	int timerFd;
+	long long start; /**< monotonic time of replay start */
+	long long lastSent; /**< monotonic time of last report */
+	bool isWaiting; /**< no frame has been received since last report */
+	unsigned long long events, frames, latencies;
+	long long latencySum, latencyMax;
+};
+
+void help(std::string name) {
+	std::cerr << "Usage: " << name << " [options] <vendor>:<product> <trace>" << std::endl
+		  << "       " << name << " --record <hidraw> <trace>" << std::endl
+		  << std::endl
+		  << "Replays hidraw traces through a keyboard driver without any hardware," << std::endl
+		  << "or records a trace from a hidraw device, until interrupted." << std::endl
+		  << std::endl
+		  << "Options:" << std::endl
+		  << "  -c, --config=<file>   Configuration file" << std::endl
+		  << "  -f, --fast            Send reports as fast as possible" << std::endl
+		  << "  -h, --help            Print this screen" << std::endl
+		  << "  -r, --record          Record trace from hidraw device" << std::endl
+		  << "  -w, --workdir=<dir>   Directory containing profile_* directories" << std::endl;
+}
+
+int record(std::string hidraw, std::string tracePath) {
+	int fd = open(hidraw.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		std::cerr << "Can't open " << hidraw << "." << std::endl;
+
+		return -1;
+	}
+
+	std::ofstream trace(tracePath);
+
+	if (!trace) {
+		std::cerr << "Can't write " << tracePath << "." << std::endl;
+		close(fd);
+
+		return -1;
+	}
+
+	trace << "# sidewinderd trace 1" << std::endl;
+	unsigned char buf[MAX_REPORT_SIZE];
+	long long start = -1;
+	ssize_t nBytes;
+
+	while ((nBytes = read(fd, buf, sizeof(buf))) > 0) {
+		long long now = MacroScheduler::now();
+
+		if (start < 0) {
+			start = now;
+		}
+
+		char hex[4];
+		trace << (now - start) / 1000;
+
+		for (ssize_t i = 0; i < nBytes; i++) {
+			std::snprintf(hex, sizeof(hex), " %02x", buf[i]);
+			trace << hex;
+		}
+
+		// flush every report, as recording ends by interrupting us
+		trace << std::endl;
+	}
+
+	close(fd);
+
+	return 0;
+}
+
+int parse(std::string tracePath, std::vector<Report> *reports) {
+	std::ifstream trace(tracePath);
+
+	if (!trace) {
+		std::cerr << "Can't read " << tracePath << "." << std::endl;
+
+		return -1;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+
+	while (std::getline(trace, line)) {
+		lineNumber++;
+
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+
+		std::istringstream stream(line);
+		struct Report report;
+		unsigned int byte;
+
+		if (!(stream >> report.time)) {
+			std::cerr << "Parse error at " << tracePath << ":" << lineNumber << std::endl;
+
+			return -1;
+		}
+
+		while (stream >> std::hex >> byte) {
+			report.data.push_back(byte);
+		}
+
+		if (report.data.empty() || report.data.size() > MAX_REPORT_SIZE) {
+			std::cerr << "Parse error at " << tracePath << ":" << lineNumber << std::endl;
+
+			return -1;
+		}
+
+		reports->push_back(report);
+	}
+
+	return 0;
+}
+
+void arm(struct Replay *replay, long long deadline) {
+	struct itimerspec its = itimerspec();
+	// zero would disarm the timer
+	deadline = deadline > 0 ? deadline : 1;
+	its.it_value.tv_sec = deadline / NSEC_PER_SEC;
+	its.it_value.tv_nsec = deadline % NSEC_PER_SEC;
+	timerfd_settime(replay->timerFd, TFD_TIMER_ABSTIME, &its, nullptr);
+}
+
+/*
+ * Sends all due reports and arms the timer for the next one. Once all reports
+ * have been sent, the replay stops after output has been idle for a while, so
+ * running macros can finish.
+ */
+void send(struct Replay *replay, Reactor *reactor) {
+	uint64_t expirations;
+	read(replay->timerFd, &expirations, sizeof(expirations));
+	long long now = MacroScheduler::now();
+
+	if (replay->next == replay->reports.size()) {
+		reactor->stop();
+
+		return;
+	}
+
+	while (replay->next < replay->reports.size()) {
+		auto &report = replay->reports[replay->next];
+		long long due = replay->start + report.time * 1000;
+
+		if (!replay->isFast && due > now) {
+			arm(replay, due);
+
+			return;
+		}
+
+		write(replay->hidFd, report.data.data(), report.data.size());
+		replay->lastSent = MacroScheduler::now();
+		replay->isWaiting = true;
+		replay->next++;
+
+		// give the driver a chance to read every single report
+		if (replay->isFast && replay->next < replay->reports.size()) {
+			arm(replay, 0);
+
+			return;
+		}
+	}
+
+	arm(replay, MacroScheduler::now() + IDLE_TIMEOUT);
+}
+
+void receive(struct Replay *replay) {
+	struct input_event events[SINK_READ_EVENTS];
+	ssize_t nBytes;
+
+	while ((nBytes = read(replay->sinkFd, events, sizeof(events))) > 0) {
+		long long now = MacroScheduler::now();
+		auto nEvents = nBytes / sizeof(struct input_event);
+
+		for (std::size_t i = 0; i < nEvents; i++) {
+			if (events[i].type == EV_SYN && events[i].code == SYN_REPORT) {
+				replay->frames++;
+
+				if (replay->isWaiting) {
+					long long latency = now - replay->lastSent;
+					replay->latencySum += latency;
+					replay->latencyMax = latency > replay->latencyMax ? latency : replay->latencyMax;
+					replay->latencies++;
+					replay->isWaiting = false;
+				}
+			} else if (events[i].type == EV_KEY) {
+				replay->events++;
+				std::cout << (now - replay->start) / 1000 << " " << events[i].code
+					  << " " << events[i].value << std::endl;
+			}
+		}
+
+		// postpone stopping, while macros are still playing
+		if (replay->next == replay->reports.size()) {
+			arm(replay, now + IDLE_TIMEOUT);
+		}
+	}
+}
+
+int play(std::string id, std::string tracePath, std::string configPath, std::string workdir, bool isFast) {
+	struct Replay replay = Replay();
+	replay.isFast = isFast;
+
+	if (parse(tracePath, &replay.reports)) {
+		return -1;
+	}
+
+	auto pos = id.find(':');
+	auto match = pos == std::string::npos ? nullptr
+		: DeviceManager::match(id.substr(0, pos).c_str(), id.substr(pos + 1).c_str());
+
+	if (!match) {
+		std::cerr << "Unsupported device " << id << "." << std::endl;
+
+		return -1;
+	}
+
+	Simulation simulation(configPath, workdir);
+	auto &reactor = simulation.reactor;
+	struct sidewinderd::DevNode devNode;
+
+	if (simulation.simulate(&devNode, &replay.hidFd, &replay.sinkFd)) {
+		std::cerr << "Can't create simulated device." << std::endl;
+
+		return -1;
+	}
+
+	fcntl(replay.sinkFd, F_SETFL, O_NONBLOCK);
+	fcntl(replay.sinkFd, F_SETPIPE_SZ, SINK_BUFFER_SIZE);
+	fcntl(devNode.uinputFd, F_SETFL, O_NONBLOCK);
+	fcntl(devNode.hidrawFd, F_SETFL, O_NONBLOCK);
+	replay.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	int sigfd = simulation.getProcess()->createSignalFd();
+
+	{
+		std::unique_ptr<Keyboard> keyboard(simulation.createKeyboard(&devNode, match));
+		keyboard->connect();
+
+		reactor.add(replay.sinkFd, EPOLLIN, [&replay](uint32_t) { receive(&replay); });
+		reactor.add(replay.timerFd, EPOLLIN, [&replay, &reactor](uint32_t) { send(&replay, &reactor); });
+		reactor.add(sigfd, EPOLLIN, [&reactor, &keyboard, sigfd](uint32_t) {
+			struct signalfd_siginfo info;
+
+			while (read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+				if (info.ssi_signo == SIGUSR1) {
+					keyboard->getStats()->dump(&std::cerr);
+				} else {
+					reactor.stop();
+				}
+			}
+		});
+
+		replay.start = MacroScheduler::now();
+		arm(&replay, replay.start);
+		reactor.run();
+
+		reactor.remove(sigfd);
+		reactor.remove(replay.timerFd);
+		reactor.remove(replay.sinkFd);
+		std::cerr << "Latency per stage:" << std::endl;
+		keyboard->getStats()->dump(&std::cerr);
+	}
+
+	long long elapsed = replay.lastSent - replay.start;
+	std::cerr << "Reports: " << replay.next << "/" << replay.reports.size() << std::endl
+		  << "Key events: " << replay.events << ", frames: " << replay.frames << std::endl;
+
+	if (elapsed > 0) {
+		std::cerr << "Throughput: " << replay.next * NSEC_PER_SEC / elapsed << " reports/s" << std::endl;
+	}
+
+	if (replay.latencies) {
+		std::cerr << "Latency: mean " << replay.latencySum / replay.latencies / 1000
+			  << " us, max " << replay.latencyMax / 1000 << " us" << std::endl;
+	}
+
+	close(sigfd);
+	close(replay.timerFd);
+	close(replay.sinkFd);
+	close(replay.hidFd);
+
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	static struct option longOptions[] = {
+		{"config", required_argument, 0, 'c'},
+		{"fast", no_argument, 0, 'f'},
+		{"help", no_argument, 0, 'h'},
+		{"record", no_argument, 0, 'r'},
+		{"workdir", required_argument, 0, 'w'},
+		{0, 0, 0, 0}
+	};
+
+	int opt, index = 0;
+	std::string configPath = "/etc/sidewinderd.conf";
+	std::string workdir;
+
+	/* flags */
+	bool isFast = false;
+	bool shouldRecord = false;
+
+	while ((opt = getopt_long(argc, argv, "c:fhrw:", longOptions, &index)) != -1) {
+		switch (opt) {
+			case 'c':
+				configPath = optarg;
+				break;
+			case 'f':
+				isFast = true;
+				break;
+			case 'h':
+				help(argv[0]);
+				return EXIT_SUCCESS;
+			case 'r':
+				shouldRecord = true;
+				break;
+			case 'w':
+				workdir = optarg;
+				break;
+			default:
+				help(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != 2) {
+		help(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int ret;
+
+	if (shouldRecord) {
+		ret = record(argv[optind], argv[optind + 1]);
+	} else {
+		ret = play(argv[optind], argv[optind + 1], configPath, workdir, isFast);
+	}
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}